@@ -0,0 +1,61 @@
+#include "animation.hpp"
+
+#include <chrono>
+#include <future>
+#include <print>
+#include <string>
+
+#include "checkpoint.hpp"
+
+namespace
+{
+    auto frame_path(const std::filesystem::path &path, std::size_t frame) -> std::filesystem::path
+    {
+        auto number = std::to_string(frame);
+        if (number.size() < 4)
+            number.insert(0, 4 - number.size(), '0');
+        auto result = path;
+        result.replace_extension();
+        result += "." + number;
+        result += path.extension();
+        return result;
+    }
+}
+
+auto render_animation(camera &cam, world &w, const world &lights, const animation &anim, const std::filesystem::path &path, const bvh_build_options &bvh_options, std::size_t thread_count) -> void
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto pending_write = std::future<void>{};
+    std::size_t frames = 0;
+    std::size_t rebuilds = 0;
+    // each frame checkpoints next to the camera's checkpoint path, so resuming picks up every frame's own film
+    const auto checkpoint_base = cam.checkpoint_path;
+
+    for (std::size_t frame = 0; frame < anim.frame_count && !render_interrupted.load(std::memory_order_relaxed); ++frame)
+    {
+        const auto time = frame / anim.frames_per_second;
+        anim.camera_keys.apply(cam, time);
+        for (const auto &object : anim.objects)
+            object->set_time(time);
+        if (frame > 0 && w.refit(bvh_options))
+            ++rebuilds;
+
+        const auto output = frame_path(path, frame);
+        if (!checkpoint_base.empty())
+            cam.checkpoint_path = frame_path(checkpoint_base, frame);
+        auto accumulated = cam.render_film(w, lights, output, thread_count);
+
+        // at most one write in flight, each with its own copy of the camera's output settings
+        if (pending_write.valid())
+            pending_write.get();
+        pending_write = std::async(std::launch::async, [writer = cam, accumulated = std::move(accumulated), output]()
+                                   { writer.write_output(accumulated, output); });
+        ++frames;
+    }
+    if (pending_write.valid())
+        pending_write.get();
+
+    const auto elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    cam.checkpoint_path = checkpoint_base;
+    std::println("finished {} frames in {:.1f}s with {} bvh rebuilds, output at {}", frames, elapsed, rebuilds, frame_path(path, 0).string());
+}
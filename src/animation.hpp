@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "common.hpp"
+#include "raytraceable.hpp"
+#include "bvh.hpp"
+#include "instance.hpp"
+#include "camera.hpp"
+
+template <typename T>
+struct keyframe
+{
+    float time;
+    T value;
+};
+
+// Values at increasing times, linearly interpolated in between and held before the first and after
+// the last key.
+template <typename T>
+struct track
+{
+    std::vector<keyframe<T>> keys{};
+
+    auto empty() const -> bool { return keys.empty(); }
+
+    auto at(float time) const -> T
+    {
+        if (keys.empty())
+            return T{};
+        if (time <= keys.front().time)
+            return keys.front().value;
+        if (time >= keys.back().time)
+            return keys.back().value;
+
+        const auto next = std::upper_bound(std::begin(keys), std::end(keys), time, [](float t, const keyframe<T> &key)
+                                           { return t < key.time; });
+        const auto &b = *next;
+        const auto &a = *(next - 1);
+        return lerp(a.value, b.value, (time - a.time) / (b.time - a.time));
+    }
+};
+
+// An object rotated about y and then translated by keyframed amounts. set_time poses it for a frame
+// by updating the instance's matrix, and the world's bvh has to be refit afterwards.
+struct animated : raytraceable
+{
+    std::shared_ptr<raytraceable> object;
+    track<vec3> translation{};
+    track<float> rotation_y_degrees{};
+
+    animated(std::shared_ptr<raytraceable> object, track<vec3> translation, track<float> rotation_y_degrees)
+        : object(object), translation(std::move(translation)), rotation_y_degrees(std::move(rotation_y_degrees)),
+          posed(instance::of(object, affine::identity())), rest(posed->to_world)
+    {
+        set_time(0.f);
+    }
+
+    auto set_time(float time) -> void
+    {
+        posed->set_transform(affine::translation(translation.at(time)) * affine::rotation_y(angle::from_degrees(rotation_y_degrees.at(time))) * rest);
+    }
+
+    auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool override { return posed->intersect(r, t, isect); }
+    auto occluded(const ray &r, const interval &t) const -> bool override { return posed->occluded(r, t); }
+    auto bbox() const -> aabb override { return posed->bbox(); }
+    auto pdf_value(const vec3 &origin, const vec3 &direction) const -> float override { return posed->pdf_value(origin, direction); }
+    auto random(const vec3 &origin, sampler &s) const -> vec3 override { return posed->random(origin, s); }
+
+private:
+    std::shared_ptr<instance> posed;
+    affine rest; // transforms folded into posed from the object itself
+};
+
+// Camera parameters over time. Empty tracks leave the camera's own value alone.
+struct camera_track
+{
+    track<vec3> look_from{};
+    track<vec3> look_at{};
+    track<float> vfov_degrees{};
+    track<float> focus_dist{};
+
+    auto apply(camera &cam, float time) const -> void
+    {
+        if (!look_from.empty())
+            cam.look_from = look_from.at(time);
+        if (!look_at.empty())
+            cam.look_at = look_at.at(time);
+        if (!vfov_degrees.empty())
+            cam.vfov = angle::from_degrees(vfov_degrees.at(time));
+        if (!focus_dist.empty())
+            cam.focus_dist = focus_dist.at(time);
+        cam.initialized = false;
+    }
+};
+
+struct animation
+{
+    camera_track camera_keys{};
+    std::vector<std::shared_ptr<animated>> objects{};
+    std::size_t frame_count = 1;
+    float frames_per_second = 24.f;
+};
+
+// Renders every frame of the animation to <stem>.<frame number><extension>. Before each frame the
+// camera and objects are posed and the world's bvh is refit, or rebuilt once refitting has degraded
+// it. A frame's image is written on another thread while the next frame renders.
+auto render_animation(camera &cam, world &w, const world &lights, const animation &anim, const std::filesystem::path &path, const bvh_build_options &bvh_options, std::size_t thread_count) -> void;
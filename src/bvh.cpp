@@ -0,0 +1,329 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <thread>
+
+namespace
+{
+    // leaf counts are stored in 16 bits
+    constexpr std::size_t max_node_primitives = std::numeric_limits<std::uint16_t>::max();
+    // Below this depth nodes are split by median instead of SAH. Median splits halve the primitives, so
+    // fewer than 2^32 of them reach single primitive leaves within another 32 levels, at bvh_max_depth.
+    constexpr std::size_t max_sah_depth = bvh_max_depth - 32;
+    // below this many primitives a node is not worth another thread
+    constexpr std::size_t min_parallel_primitives = 16 * 1024;
+
+    // Splits [start, end) into one chunk per thread, runs chunk_fn(chunk_start, chunk_end) -> T on each
+    // and folds the results with merge. Small ranges stay on the calling thread.
+    template <typename T, typename chunk_fn, typename merge_fn>
+    auto parallel_reduce(std::size_t start, std::size_t end, std::size_t threads, chunk_fn &&chunk, merge_fn &&merge) -> T
+    {
+        threads = std::min(threads, (end - start) / min_parallel_primitives);
+        if (threads <= 1)
+            return chunk(start, end);
+
+        auto results = std::vector<T>(threads);
+        auto workers = std::vector<std::thread>{};
+        workers.reserve(threads - 1);
+        const auto chunk_size = (end - start + threads - 1) / threads;
+        for (std::size_t t = 1; t < threads; ++t)
+        {
+            const auto chunk_start = std::min(end, start + t * chunk_size);
+            const auto chunk_end = std::min(end, chunk_start + chunk_size);
+            workers.emplace_back([&, t, chunk_start, chunk_end]()
+                                 { results[t] = chunk(chunk_start, chunk_end); });
+        }
+        results[0] = chunk(start, std::min(end, start + chunk_size));
+        for (auto &worker : workers)
+            worker.join();
+
+        auto result = results[0];
+        for (std::size_t t = 1; t < threads; ++t)
+            result = merge(result, results[t]);
+        return result;
+    }
+
+    struct bvh_bin
+    {
+        aabb bounds = aabb::empty;
+        std::size_t count = 0;
+    };
+
+    struct node_bounds
+    {
+        aabb bbox = aabb::empty;
+        aabb centroid_bounds = aabb::empty;
+    };
+
+    auto bin_index(const bvh_build_primitive &prim, const interval &centroid_range, int axis, std::size_t bin_count) -> std::size_t
+    {
+        const auto offset = (prim.centroid.data[axis] - centroid_range.min) / centroid_range.size();
+        return std::min(static_cast<std::size_t>(offset * bin_count), bin_count - 1);
+    }
+
+    auto split_median(std::vector<bvh_build_primitive> &prims, std::size_t start, std::size_t end, int axis) -> std::size_t
+    {
+        const auto mid = start + (end - start) / 2;
+        std::nth_element(std::begin(prims) + start, std::begin(prims) + mid, std::begin(prims) + end, [axis](const bvh_build_primitive &a, const bvh_build_primitive &b)
+                         { return a.centroid.data[axis] < b.centroid.data[axis]; });
+        return mid;
+    }
+
+    struct bvh_builder
+    {
+        const bvh_build_options &options;
+        std::vector<bvh_build_primitive> &prims;
+        std::size_t bin_count = std::max<std::size_t>(options.bin_count, 2);
+
+        auto bounds_of(std::size_t start, std::size_t end, std::size_t threads) const -> node_bounds
+        {
+            return parallel_reduce<node_bounds>(
+                start, end, threads,
+                [&](std::size_t chunk_start, std::size_t chunk_end)
+                {
+                    auto b = node_bounds{};
+                    for (auto i = chunk_start; i < chunk_end; ++i)
+                    {
+                        b.bbox = aabb::from_aabbs(b.bbox, prims[i].bounds);
+                        b.centroid_bounds = aabb::from_aabbs(b.centroid_bounds, aabb::from_points(prims[i].centroid, prims[i].centroid));
+                    }
+                    return b;
+                },
+                [](const node_bounds &a, const node_bounds &b)
+                { return node_bounds{aabb::from_aabbs(a.bbox, b.bbox), aabb::from_aabbs(a.centroid_bounds, b.centroid_bounds)}; });
+        }
+
+        // Bins every primitive on all three axes in one pass.
+        auto fill_bins(std::size_t start, std::size_t end, const aabb &centroid_bounds, std::size_t threads) const -> std::array<std::vector<bvh_bin>, 3>
+        {
+            using axis_bins = std::array<std::vector<bvh_bin>, 3>;
+            return parallel_reduce<axis_bins>(
+                start, end, threads,
+                [&](std::size_t chunk_start, std::size_t chunk_end)
+                {
+                    auto bins = axis_bins{};
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        bins[axis].resize(bin_count);
+                        const auto &range = centroid_bounds.axis_interval(axis);
+                        if (range.size() <= 0.f)
+                            continue;
+                        for (auto i = chunk_start; i < chunk_end; ++i)
+                        {
+                            auto &bin = bins[axis][bin_index(prims[i], range, axis, bin_count)];
+                            bin.bounds = aabb::from_aabbs(bin.bounds, prims[i].bounds);
+                            ++bin.count;
+                        }
+                    }
+                    return bins;
+                },
+                [&](axis_bins a, const axis_bins &b)
+                {
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        for (std::size_t i = 0; i < bin_count; ++i)
+                        {
+                            a[axis][i].bounds = aabb::from_aabbs(a[axis][i].bounds, b[axis][i].bounds);
+                            a[axis][i].count += b[axis][i].count;
+                        }
+                    }
+                    return a;
+                });
+        }
+
+        // Cost of intersecting count primitives in one leaf, counted in leaf tests.
+        auto leaf_cost(std::size_t count) const -> float
+        {
+            const auto lanes = std::max(options.leaf_lanes, std::size_t{1});
+            return static_cast<float>((count + lanes - 1) / lanes);
+        }
+
+        // Returns the partition point of the cheapest binned SAH split, or `start` when a leaf is cheaper.
+        auto split_sah(std::size_t start, std::size_t end, const node_bounds &bounds, std::size_t threads, int &split_axis) const -> std::size_t
+        {
+            const auto bins = fill_bins(start, end, bounds.centroid_bounds, threads);
+            auto right_area = std::vector<float>(bin_count);
+            auto right_count = std::vector<std::size_t>(bin_count);
+
+            auto best_cost = infinity;
+            auto best_axis = -1;
+            auto best_bin = std::size_t{0};
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (bounds.centroid_bounds.axis_interval(axis).size() <= 0.f)
+                    continue;
+
+                // sweep from the right so that right_*[b] describe bins b..bin_count-1
+                auto box = aabb::empty;
+                auto count = std::size_t{0};
+                for (auto b = bin_count - 1; b > 0; --b)
+                {
+                    box = aabb::from_aabbs(box, bins[axis][b].bounds);
+                    count += bins[axis][b].count;
+                    right_area[b] = count > 0 ? box.surface_area() : 0.f;
+                    right_count[b] = count;
+                }
+
+                // sweep from the left, evaluating the split between bins b-1 and b
+                box = aabb::empty;
+                count = 0;
+                for (std::size_t b = 1; b < bin_count; ++b)
+                {
+                    box = aabb::from_aabbs(box, bins[axis][b - 1].bounds);
+                    count += bins[axis][b - 1].count;
+                    if (count == 0 || right_count[b] == 0)
+                        continue;
+
+                    const auto cost = leaf_cost(count) * box.surface_area() + leaf_cost(right_count[b]) * right_area[b];
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_bin = b;
+                    }
+                }
+            }
+
+            const auto object_span = end - start;
+            if (best_axis < 0)
+                return start;
+
+            const auto split_cost = options.traversal_cost + best_cost / bounds.bbox.surface_area();
+            if (object_span <= options.max_leaf_size && leaf_cost(object_span) <= split_cost)
+                return start;
+
+            const auto &range = bounds.centroid_bounds.axis_interval(best_axis);
+            const auto mid = std::partition(std::begin(prims) + start, std::begin(prims) + end, [&](const bvh_build_primitive &prim)
+                                            { return bin_index(prim, range, best_axis, bin_count) < best_bin; });
+            split_axis = best_axis;
+            return static_cast<std::size_t>(mid - std::begin(prims));
+        }
+
+        // Appends the subtree over [start, end) to `nodes` in depth first order. Large subtrees hand
+        // their first child to a new thread, which builds into its own array that is spliced in after.
+        auto build(std::vector<bvh_node> &nodes, std::size_t start, std::size_t end, std::size_t threads, std::size_t depth = 0) const -> void
+        {
+            const auto bounds = bounds_of(start, end, threads);
+
+            const auto node_index = nodes.size();
+            nodes.emplace_back();
+            nodes[node_index].set_bounds(bounds.bbox);
+
+            const auto make_leaf = [&]()
+            {
+                nodes[node_index].offset = static_cast<std::uint32_t>(start);
+                nodes[node_index].count = static_cast<std::uint16_t>(end - start);
+            };
+
+            const auto object_span = end - start;
+            if (object_span <= 1)
+            {
+                make_leaf();
+                return;
+            }
+
+            auto axis = bounds.centroid_bounds.longest_axis();
+            auto mid = start;
+            if (options.split == bvh_split_method::sah && depth < max_sah_depth)
+            {
+                mid = split_sah(start, end, bounds, threads, axis);
+                if (mid == start && object_span > max_node_primitives)
+                    mid = split_median(prims, start, end, axis);
+            }
+            else if (object_span > options.max_leaf_size)
+            {
+                mid = split_median(prims, start, end, axis);
+            }
+
+            if (mid == start || mid == end)
+            {
+                make_leaf();
+                return;
+            }
+
+            nodes[node_index].count = 0;
+            nodes[node_index].axis = static_cast<std::uint8_t>(axis);
+
+            if (threads <= 1 || object_span < min_parallel_primitives)
+            {
+                build(nodes, start, mid, 1, depth + 1);
+                nodes[node_index].offset = static_cast<std::uint32_t>(nodes.size());
+                build(nodes, mid, end, 1, depth + 1);
+                return;
+            }
+
+            // share the threads between the children in proportion to their size
+            const auto left_threads = std::clamp<std::size_t>((threads * (mid - start) + object_span / 2) / object_span, 1, threads - 1);
+            auto left_nodes = std::vector<bvh_node>{};
+            auto right_nodes = std::vector<bvh_node>{};
+            auto left_worker = std::thread([&]()
+                                           { build(left_nodes, start, mid, left_threads, depth + 1); });
+            build(right_nodes, mid, end, threads - left_threads, depth + 1);
+            left_worker.join();
+
+            splice(nodes, left_nodes);
+            nodes[node_index].offset = static_cast<std::uint32_t>(nodes.size());
+            splice(nodes, right_nodes);
+        }
+
+        static auto splice(std::vector<bvh_node> &nodes, const std::vector<bvh_node> &subtree) -> void
+        {
+            const auto base = static_cast<std::uint32_t>(nodes.size());
+            for (auto node : subtree)
+            {
+                if (!node.is_leaf())
+                    node.offset += base;
+                nodes.push_back(node);
+            }
+        }
+    };
+}
+
+auto bvh_tree::build(std::vector<bvh_build_primitive> prims, const bvh_build_options &options) -> bvh_tree
+{
+    auto tree = bvh_tree{};
+    if (prims.empty())
+        return tree;
+
+    tree.nodes.reserve(2 * prims.size());
+    const auto builder = bvh_builder{options, prims};
+    builder.build(tree.nodes, 0, prims.size(), std::max<std::size_t>(options.threads, 1));
+    tree.nodes.shrink_to_fit();
+
+    tree.order.resize(prims.size());
+    for (std::size_t i = 0; i < prims.size(); ++i)
+    {
+        tree.order[i] = prims[i].index;
+    }
+    return tree;
+}
+
+auto bvh::from_world(const world &w, const bvh_build_options &options) -> bvh
+{
+    auto prims = std::vector<bvh_build_primitive>(w.objs.size());
+    parallel_reduce<int>(
+        0, w.objs.size(), options.threads,
+        [&](std::size_t start, std::size_t end)
+        {
+            for (auto i = start; i < end; ++i)
+            {
+                const auto bounds = w.objs[i]->bbox();
+                prims[i] = {bounds, bounds.centroid(), static_cast<std::uint32_t>(i)};
+            }
+            return 0;
+        },
+        [](int, int)
+        { return 0; });
+
+    auto b = bvh{};
+    b.tree = bvh_tree::build(std::move(prims), options);
+    b.objs.resize(w.objs.size());
+    for (std::size_t i = 0; i < b.tree.order.size(); ++i)
+    {
+        b.objs[i] = w.objs[b.tree.order[i]];
+    }
+    return b;
+}
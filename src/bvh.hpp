@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "common.hpp"
+#include "raytraceable.hpp"
+
+// No leaf of a built bvh is deeper than this, which bounds the traversal stacks.
+inline constexpr std::size_t bvh_max_depth = 64;
+
+// One node of a flattened bvh. Nodes are stored depth first, so the first child of an interior node
+// is always the next node in the array and only the second child needs an index.
+struct bvh_node
+{
+    float bounds_min[3];
+    float bounds_max[3];
+    std::uint32_t offset; // leaf: first primitive, interior: index of the second child
+    std::uint16_t count;  // number of primitives, 0 for interior nodes
+    std::uint8_t axis;    // split axis of interior nodes
+    std::uint8_t pad;
+
+    auto is_leaf() const -> bool { return count > 0; }
+
+    auto bounds() const -> aabb
+    {
+        return aabb{
+            interval{bounds_min[0], bounds_max[0]},
+            interval{bounds_min[1], bounds_max[1]},
+            interval{bounds_min[2], bounds_max[2]}};
+    }
+
+    auto set_bounds(const aabb &box) -> void
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            bounds_min[axis] = box.axis_interval(axis).min;
+            bounds_max[axis] = box.axis_interval(axis).max;
+        }
+    }
+
+    auto hit(const vec3 &origin, const vec3 &inv_dir, interval ray_t) const -> bool
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            auto t0 = (bounds_min[axis] - origin.data[axis]) * inv_dir.data[axis];
+            auto t1 = (bounds_max[axis] - origin.data[axis]) * inv_dir.data[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            ray_t.min = t0 > ray_t.min ? t0 : ray_t.min;
+            ray_t.max = t1 < ray_t.max ? t1 : ray_t.max;
+            if (ray_t.max <= ray_t.min)
+                return false;
+        }
+        return true;
+    }
+};
+
+static_assert(sizeof(bvh_node) == 32);
+
+enum class bvh_split_method
+{
+    median,
+    sah,
+};
+
+struct bvh_build_options
+{
+    bvh_split_method split = bvh_split_method::sah;
+    std::size_t bin_count = 16;
+    // nodes with at most this many primitives become leaves when splitting does not pay off
+    std::size_t max_leaf_size = 4;
+    // cost of visiting a node relative to intersecting one primitive
+    float traversal_cost = 1.f;
+    // primitives a leaf test handles at once, e.g. the SIMD lanes of a sphere pool kernel. A leaf of n
+    // primitives costs ceil(n / leaf_lanes), so SAH fills leaves up to a whole vector before splitting.
+    std::size_t leaf_lanes = 1;
+    // children per node: 2 keeps the binary bvh, 4 or 8 collapse it into a wide bvh tested with SIMD
+    std::size_t width = 8;
+    // threads used for the build; large subtrees and the binning of large nodes run in parallel
+    std::size_t threads = 1;
+};
+
+struct bvh_build_primitive
+{
+    aabb bounds;
+    vec3 centroid;
+    std::uint32_t index;
+};
+
+// Node array plus the order the primitives were arranged in. Owners reorder their primitive storage
+// by `order` so that every leaf covers the contiguous range [offset, offset + count).
+struct bvh_tree
+{
+    std::vector<bvh_node> nodes{};
+    std::vector<std::uint32_t> order{};
+
+    static auto build(std::vector<bvh_build_primitive> prims, const bvh_build_options &options = {}) -> bvh_tree;
+
+    auto bbox() const -> aabb { return nodes.empty() ? aabb::empty : nodes[0].bounds(); }
+
+    // Recomputes every node's bounds from primitive_bounds(i) of the primitives in its leaves, keeping
+    // the topology. Children always come after their parent, so one backwards pass suffices. Returns
+    // the tree's surface area heuristic cost, which grows as moving primitives make the old splits worse.
+    template <typename primitive_bounds_fn>
+    auto refit(primitive_bounds_fn &&primitive_bounds) -> float
+    {
+        auto cost = 0.f;
+        for (auto i = nodes.size(); i-- > 0;)
+        {
+            auto &node = nodes[i];
+            auto box = aabb::empty;
+            if (node.is_leaf())
+            {
+                for (auto p = node.offset; p < node.offset + node.count; ++p)
+                    box = aabb::from_aabbs(box, primitive_bounds(p));
+                cost += node.count * box.surface_area();
+            }
+            else
+            {
+                box = aabb::from_aabbs(nodes[i + 1].bounds(), nodes[node.offset].bounds());
+                cost += box.surface_area();
+            }
+            node.set_bounds(box);
+        }
+        return nodes.empty() ? 0.f : cost / std::max(nodes[0].bounds().surface_area(), 1e-12f);
+    }
+
+    // Visits the nodes hit by the ray front to back. leaf_hit(first, count, ray_t) intersects a leaf's
+    // primitives and returns whether it found a hit, shrinking ray_t.max to the closest one. With
+    // any_hit the traversal ends at the first leaf that reports a hit.
+    template <bool any_hit = false, typename leaf_hit_fn>
+    auto traverse(const ray &r, interval ray_t, leaf_hit_fn &&leaf_hit) const -> bool
+    {
+        if (nodes.empty())
+            return false;
+
+        const auto inv_dir = vec3{1.f / r.direction.x, 1.f / r.direction.y, 1.f / r.direction.z};
+        const bool dir_is_neg[3] = {inv_dir.x < 0.f, inv_dir.y < 0.f, inv_dir.z < 0.f};
+
+        std::uint32_t stack[bvh_max_depth];
+        std::size_t stack_size = 0;
+        std::uint32_t current = 0;
+        bool hit_anything = false;
+
+        while (true)
+        {
+            const auto &node = nodes[current];
+            if (node.hit(r.origin, inv_dir, ray_t))
+            {
+                if (node.is_leaf())
+                {
+                    hit_anything |= leaf_hit(node.offset, node.count, ray_t);
+                    if constexpr (any_hit)
+                    {
+                        if (hit_anything)
+                            break;
+                    }
+                    if (stack_size == 0)
+                        break;
+                    current = stack[--stack_size];
+                }
+                else if (dir_is_neg[node.axis])
+                {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                }
+                else
+                {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+            }
+            else
+            {
+                if (stack_size == 0)
+                    break;
+                current = stack[--stack_size];
+            }
+        }
+
+        return hit_anything;
+    }
+};
+
+struct bvh : raytraceable
+{
+    std::vector<std::shared_ptr<raytraceable>> objs{};
+    bvh_tree tree{};
+    float build_cost = 0.f; // refit() cost right after the build
+
+    virtual ~bvh() = default;
+
+    static auto from_world(const world &w, const bvh_build_options &options = {}) -> bvh;
+
+    // Updates the bounds after primitives moved and returns the new surface area heuristic cost.
+    virtual auto refit() -> float
+    {
+        return tree.refit([&](std::uint32_t i)
+                          { return objs[i]->bbox(); });
+    }
+
+    auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool override
+    {
+        return tree.traverse(r, t, [&](std::uint32_t first, std::uint32_t count, interval &ray_t)
+                             {
+            bool hit_anything = false;
+            for (auto i = first; i < first + count; ++i)
+            {
+                if (objs[i]->intersect(r, ray_t, isect))
+                {
+                    hit_anything = true;
+                    ray_t.max = isect.t;
+                }
+            }
+            return hit_anything; });
+    }
+
+    auto occluded(const ray &r, const interval &t) const -> bool override
+    {
+        return tree.traverse<true>(r, t, [&](std::uint32_t first, std::uint32_t count, const interval &ray_t)
+                                   {
+            for (auto i = first; i < first + count; ++i)
+            {
+                if (objs[i]->occluded(r, ray_t))
+                    return true;
+            }
+            return false; });
+    }
+
+    auto bbox() const -> aabb override { return tree.bbox(); }
+
+    auto pdf_value(const vec3 &origin, const vec3 &direction) const -> float override
+    {
+        const auto weight = 1.f / objs.size();
+        auto sum = 0.f;
+        for (const auto &obj : objs)
+            sum += weight * obj->pdf_value(origin, direction);
+        return sum;
+    }
+
+    auto random(const vec3 &origin, sampler &s) const -> vec3 override
+    {
+        const auto i = std::min(static_cast<std::size_t>(s.get_1d() * objs.size()), objs.size() - 1);
+        return objs[i]->random(origin, s);
+    }
+};
+
+// Builds the acceleration structure world::optimize installs: a binary bvh over the world's objects,
+// collapsed to a wide bvh when options.width asks for one.
+auto build_bvh(const world &w, const bvh_build_options &options = {}) -> std::shared_ptr<bvh>;
@@ -6,29 +6,26 @@
 #include <chrono>
 #include <string>
 #include <thread>
-#include <functional>
-#include <unordered_map>
+#include <vector>
 
 #include "common.hpp"
 #include "raytraceable.hpp"
 #include "material.hpp"
 #include "image.hpp"
-
-auto seconds_to_time_display_units(float seconds, float &units, std::string &unit_name) -> void
+#include "film.hpp"
+#include "checkpoint.hpp"
+#include "sampler.hpp"
+#include "tiles.hpp"
+#include "progress.hpp"
+#include "denoiser.hpp"
+
+// Work done rendering one tile.
+struct tile_stats
 {
-    units = seconds;
-    unit_name = "seconds";
-    if (units > 60.f)
-    {
-        units /= 60.f;
-        unit_name = "minutes";
-    }
-    if (units > 60.f)
-    {
-        units /= 60.f;
-        unit_name = "hours";
-    }
-}
+    std::uint64_t samples = 0;
+    std::uint64_t rays = 0; // camera and bounce rays traced against the scene
+    std::uint64_t skipped = 0; // samples left untaken by pixels that converged in this tile
+};
 
 struct camera
 {
@@ -36,7 +33,17 @@ struct camera
     std::size_t image_width = 100.f;
     bool initialized = false;
     std::size_t samples_per_pixel = 10;
+    // Adaptive sampling replaces the fixed samples_per_pixel: every pixel takes at least
+    // min_samples_per_pixel and stops once its relative error drops below adaptive_target_error or
+    // it reaches max_samples_per_pixel.
+    bool adaptive_sampling = false;
+    std::size_t min_samples_per_pixel = 16;
+    std::size_t max_samples_per_pixel = 1024;
+    float adaptive_target_error = 0.02f;
+    sampler_type sampling = sampler_type::sobol;
     std::size_t max_depth = 10;
+    bool russian_roulette = true;
+    std::size_t russian_roulette_min_depth = 3; // bounces that always run before roulette can end a path
     color background;
     angle vfov = angle::from_degrees(90);
     vec3 look_from = vec3{0.f, 0.f, 0.f};
@@ -45,67 +52,189 @@ struct camera
 
     angle defocus_angle = angle::from_radians(0.f);
     float focus_dist = 10.f;
+    std::uint64_t seed = 0;
+    std::size_t tile_size = 16;
+    std::chrono::milliseconds progress_interval{1000};
+    // Progressive rendering adds pass_samples to every pixel per pass until the sample cap or
+    // time_budget (zero for none) is reached, rewriting the output every preview_interval.
+    bool progressive = false;
+    std::size_t pass_samples = 4;
+    std::chrono::seconds time_budget{0};
+    std::chrono::seconds preview_interval{30};
+    // With a checkpoint_path the film is saved there every checkpoint_interval and when the render is
+    // interrupted, and `resume` continues from it.
+    std::filesystem::path checkpoint_path{};
+    std::chrono::seconds checkpoint_interval{300};
+    bool resume = false;
+    // .pfm, .hdr and .exr outputs keep linear radiance, other formats are tone mapped to 8 bits
+    tonemap_settings tonemap{};
+    bool half_float_output = false;
+    // Filters the written image with the denoiser, guided by the albedo, normal and depth the samples
+    // saw, so low sample counts give clean images.
+    bool denoise = false;
+    denoise_settings denoiser{};
+    // Written from the same samples as the image, each to <stem>.<aov name> next to it as .exr, or in
+    // the image's own format when that is .pfm or .exr.
+    std::vector<aov> aovs{};
 
     auto render(const world &w, const world &lights, std::filesystem::path path, std::size_t thread_count = 1) -> void
+    {
+        auto start = std::chrono::steady_clock::now();
+        const auto accumulated = render_film(w, lights, path, thread_count);
+        write_output(accumulated, path, thread_count);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        float elapsed_time = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
+        std::string time_unit = "seconds";
+        seconds_to_time_display_units(elapsed_time, elapsed_time, time_unit);
+        std::println("finished in {}{}, output at {}", elapsed_time, time_unit, path.string());
+    }
+
+    // Renders the image into a film without writing it. Progressive previews still go to path.
+    auto render_film(const world &w, const world &lights, const std::filesystem::path &path, std::size_t thread_count = 1) -> film
     {
         if (!initialized)
             init();
 
-        auto img = image{image_width, image_height};
-        std::println("rendering {}x{} image at {} samples per pixel to {}", image_width, image_height, samples_per_pixel, path.string());
-        auto start = std::chrono::high_resolution_clock::now();
+        thread_count = std::max<std::size_t>(thread_count, 1);
+        const auto max_samples = max_samples_for_pixel();
+        if (adaptive_sampling)
+            std::println("rendering {}x{} image at {} to {} samples per pixel to {}", image_width, image_height, min_samples_per_pixel, max_samples, path.string());
+        else
+            std::println("rendering {}x{} image at {} samples per pixel to {}", image_width, image_height, max_samples, path.string());
+        if (thread_count > 1)
+            std::println("using {} threads", thread_count);
+        auto start = std::chrono::steady_clock::now();
 
-        auto threads_progress = std::unordered_map<std::size_t, float>();
-        auto report_progress = [&](std::size_t thread_id, float percent_done)
+        // A single pass of every sample unless rendering progressively. Checkpoints are taken between
+        // passes, so checkpointed renders are split into passes as well.
+        const auto multi_pass = progressive || !checkpoint_path.empty();
+        const auto samples_per_pass = multi_pass ? std::max<std::size_t>(pass_samples, 1) : max_samples;
+        const auto passes = (max_samples + samples_per_pass - 1) / samples_per_pass;
+        const auto deadline = progressive && time_budget.count() > 0 ? start + time_budget : std::chrono::steady_clock::time_point::max();
+
+        auto accumulated = make_film();
+        if (resume && !checkpoint_path.empty())
         {
-            const auto elapsed = std::chrono::high_resolution_clock::now() - start;
+            if (load_checkpoint(checkpoint_path, accumulated, checkpoint_config()))
+                std::println("resuming from {}", checkpoint_path.string());
+            else
+                std::println("no usable checkpoint at {}, starting over", checkpoint_path.string());
+        }
+        auto progress = progress_reporter{thread_count, outstanding_samples(accumulated), progress_interval};
+        progress.deadline = deadline;
+        progress.start();
 
-            auto &thread_progress = threads_progress[thread_id];
-            thread_progress += percent_done;
+        auto last_write = start;
+        auto last_checkpoint = start;
+        for (std::size_t pass = 0; pass < passes && std::chrono::steady_clock::now() < deadline && !render_interrupted.load(std::memory_order_relaxed); ++pass)
+        {
+            render_pass(accumulated, (pass + 1) * samples_per_pass, deadline, w, lights, progress, thread_count);
 
-            float percent_done_total = 0.f;
-            for (const auto &[thread_id, percent_done] : threads_progress)
+            if (!checkpoint_path.empty() && pass + 1 < passes && std::chrono::steady_clock::now() - last_checkpoint >= checkpoint_interval)
             {
-                percent_done_total += percent_done / thread_count;
+                if (!save_checkpoint(checkpoint_path, accumulated, checkpoint_config()))
+                    std::println("failed to write checkpoint {}", checkpoint_path.string());
+                last_checkpoint = std::chrono::steady_clock::now();
             }
 
-            const auto elapsed_s = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
-            auto estimated_time_left = elapsed_s / percent_done_total * (100.f - percent_done_total);
-            std::string time_unit = "seconds";
-            seconds_to_time_display_units(estimated_time_left, estimated_time_left, time_unit);
-            std::println("{}% in {}s, estimated {}{} left", percent_done_total, elapsed_s, estimated_time_left, time_unit);
-        };
-        if (thread_count > 1)
-        {
-            std::println("using {} threads", thread_count);
-            std::vector<std::thread> threads;
-            for (std::size_t i = 0; i < thread_count; ++i)
+            if (progressive && pass + 1 < passes && std::chrono::steady_clock::now() - last_write >= preview_interval)
             {
-                threads.emplace_back([&, i]()
-                                     { render_thread(i, thread_count, w, lights, img, report_progress); });
+                write_output(accumulated, path, thread_count);
+                last_write = std::chrono::steady_clock::now();
             }
-            for (std::size_t i = 0; i < threads.size(); ++i)
+        }
+
+        // Running out of time budget ends the render like running out of passes does.
+        if (render_interrupted.load(std::memory_order_relaxed))
+            progress.stop();
+        else
+            progress.finish();
+        if (render_interrupted.load(std::memory_order_relaxed) && !checkpoint_path.empty())
+        {
+            if (save_checkpoint(checkpoint_path, accumulated, checkpoint_config()))
+                std::println("interrupted, checkpoint written to {}", checkpoint_path.string());
+            else
+                std::println("interrupted, failed to write checkpoint {}", checkpoint_path.string());
+        }
+        return accumulated;
+    }
+
+    auto prepare() -> void
+    {
+        if (!initialized)
+            init();
+    }
+
+    auto image_size(std::size_t &width, std::size_t &height) const -> void
+    {
+        width = image_width;
+        height = image_height;
+    }
+
+    // A film with one pixel_estimate per pixel of the image this camera renders.
+    auto make_film() -> film
+    {
+        prepare();
+        return film{image_width, image_height};
+    }
+
+    auto max_samples_for_pixel() const -> std::size_t
+    {
+        return adaptive_sampling ? std::max(max_samples_per_pixel, min_samples_per_pixel) : samples_per_pixel;
+    }
+
+    auto checkpoint_config() const -> checkpoint_settings
+    {
+        return checkpoint_settings{seed, sampling, static_cast<std::uint32_t>(max_samples_for_pixel()), static_cast<std::uint32_t>(max_depth), adaptive_sampling, static_cast<std::uint32_t>(min_samples_per_pixel), adaptive_target_error, static_cast<std::uint32_t>(pass_samples), denoise || !aovs.empty()};
+    }
+
+    // Brings every pixel of tile t up to sample_end samples, stopping early on converged pixels. The
+    // estimate of pixel (x, y) is pixels[(y - t.y0) * stride + (x - t.x0)]. The camera must have been
+    // prepared first.
+    auto render_tile(const tile &t, std::size_t sample_end, const world &w, const world &lights, sampler &pixel_sampler, pixel_estimate *pixels, std::size_t stride) const -> tile_stats
+    {
+        auto stats = tile_stats{};
+        sample_end = std::min(sample_end, max_samples_for_pixel());
+        for (std::size_t i = t.y0; i < t.y1; ++i)
+        {
+            for (std::size_t j = t.x0; j < t.x1; ++j)
             {
-                threads[i].join();
+                auto &estimate = pixels[(i - t.y0) * stride + (j - t.x0)];
+                const auto pixel_index = i * image_width + j;
+                const auto was_converged = converged(estimate);
+                for (std::size_t sample = estimate.samples; sample < sample_end && !converged(estimate); ++sample)
+                {
+                    seed_thread_rng(seed, pixel_index, sample);
+                    pixel_sampler.start_pixel_sample(j, i, sample);
+                    const auto r = get_ray(j, i, pixel_sampler);
+                    auto features = surface_features{};
+                    const auto c = ray_color(r, w, lights, pixel_sampler, stats.rays, features);
+                    estimate.add(c, features);
+                    ++stats.samples;
+                }
+                if (!was_converged && converged(estimate))
+                    stats.skipped += max_samples_for_pixel() - std::min<std::size_t>(estimate.samples, max_samples_for_pixel());
             }
         }
-        else
+        return stats;
+    }
+
+    auto write_output(const film &accumulated, const std::filesystem::path &path, std::size_t thread_count = 1) const -> void
+    {
+        const auto img = denoise ? denoise_film(accumulated, denoiser, thread_count) : accumulated.to_hdr();
+        if (!img.write(path, tonemap, half_float_output))
+            std::println("failed to write {}", path.string());
+
+        for (const auto a : aovs)
         {
-            render_thread(0, 1, w, lights, img, report_progress);
+            const auto aov_file = aov_path(path, a);
+            if (!accumulated.aov_image(a).write(aov_file, tonemap, half_float_output && !aov_is_id(a)))
+                std::println("failed to write {}", aov_file.string());
         }
-        img.write(path);
-        auto elapsed = std::chrono::high_resolution_clock::now() - start;
-        float elapsed_time = std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
-        std::string time_unit = "seconds";
-        seconds_to_time_display_units(elapsed_time, elapsed_time, time_unit);
-        std::println("finished in {}{}, output at {}", elapsed_time, time_unit, path.string());
     }
 
 private:
     std::size_t image_height{};
-    float pixel_sample_scale{};
-    int sqrt_spp{};
-    float recip_sqrt_spp{};
     vec3 center{};
     vec3 pixel00_loc{};
     vec3 pixel_delta_u{};
@@ -118,10 +247,6 @@ private:
     {
         image_height = std::max(static_cast<int>(image_width / aspect_ratio), 1);
 
-        sqrt_spp = static_cast<int>(std::sqrtf(samples_per_pixel));
-        pixel_sample_scale = 1.f / (sqrt_spp * sqrt_spp);
-        recip_sqrt_spp = 1.f / sqrt_spp;
-
         center = look_from;
 
         const auto theta = vfov.radians;
@@ -147,104 +272,193 @@ private:
         defocus_disk_v = v * defocus_radius;
     }
 
-    auto ray_color(const ray &r, std::size_t depth, const world &w, const world &lights) const -> color
+    // Follows one path iteratively, carrying the product of the bounce weights in `throughput`. The
+    // surface features are recorded at the first hit that is not specular.
+    auto ray_color(const ray &camera_ray, const world &w, const world &lights, sampler &s, std::uint64_t &rays, surface_features &features) const -> color
     {
-        if (depth <= 0)
-        {
-            return color{0, 0, 0};
-        }
-        hit_result res;
-        if (!w.hit(r, interval{0.001f, infinity}, res))
+        auto r = camera_ray;
+        auto radiance = color{0, 0, 0};
+        auto throughput = color{1, 1, 1};
+        auto specular_weight = color{1, 1, 1};
+        auto path_length = 0.f;
+        auto features_found = false;
+
+        for (std::size_t depth = 0; depth < max_depth; ++depth)
         {
-            return background;
-            // const float t = 0.5 * (r.direction.y + 1.0f);
-            // return lerp(color{1.0f, 1.0f, 1.0f}, color{0.5f, 0.7f, 1.0f}, t);
-        }
+            hit_result res;
+            ++rays;
+            if (!w.hit(r, interval{0.001f, infinity}, res, &s))
+            {
+                radiance += throughput * background;
+                break;
+            }
 
-        scatter_result sres;
-        const auto color_from_emission = res.mat->emitted(r, res, res.u, res.v, res.p);
+            // the material is only looked up once the closest hit is known
+            const auto &mat = w.material_of(res);
+            radiance += throughput * mat.emitted(r, res, res.u, res.v, res.p);
 
-        if (!res.mat->scatter(r, res, sres))
-        {
-            return color_from_emission;
-        }
+            scatter_result sres;
+            const auto scatters = mat.scatter(r, res, sres, s);
+            if (!features_found)
+            {
+                path_length += res.t * r.direction.magnitude();
+                if (scatters && sres.skip_pdf)
+                {
+                    specular_weight *= sres.attenuation;
+                }
+                else
+                {
+                    features = surface_features{specular_weight * mat.surface_albedo(res), res.normal, path_length, screen_motion(res.p, res.velocity, r.time), res.mat, res.prim, res.instance};
+                    features_found = true;
+                }
+            }
+            if (!scatters)
+                break;
 
-        if (sres.skip_pdf)
-        {
-            return sres.attenuation * ray_color(sres.skip_pdf_ray, depth - 1, w, lights);
-        }
+            if (sres.skip_pdf)
+            {
+                throughput *= sres.attenuation;
+                r = sres.skip_pdf_ray;
+            }
+            else
+            {
+                // scenes without lights to sample, like the sky lit ones, sample the material alone
+                const auto p = lights.objs.empty() ? mixture_pdf{sres.sampling_pdf, sres.sampling_pdf} : mixture_pdf{raytraceable_pdf{lights, res.p}, sres.sampling_pdf};
+                const auto scattered = ray{res.p, p.generate(s), r.time};
+                const auto pdf_value = p.value(scattered.direction);
+                const auto scatter_pdf = mat.scatter_pdf(r, res, scattered);
+                throughput *= sres.attenuation * scatter_pdf / pdf_value;
+                r = scattered;
+            }
 
-        const auto light_ptr = std::make_shared<raytraceable_pdf>(lights, res.p);
-        const auto p = mixture_pdf{light_ptr, sres.pdf_ptr};
+            // Russian roulette: end dim paths at random and boost the survivors so the estimate stays unbiased
+            if (russian_roulette && depth + 1 >= russian_roulette_min_depth)
+            {
+                const auto survival = std::min(throughput.max_component(), 0.95f);
+                if (survival <= 0.f || s.get_1d() >= survival)
+                    break;
+                throughput /= survival;
+            }
+        }
 
-        const auto scattered = ray{res.p, p.generate(), r.time};
-        const auto pdf_value = p.value(scattered.direction);
+        // paths that escape or end on specular bounces see no surface, only the light they carry
+        if (!features_found)
+            features.albedo = specular_weight;
+        return radiance;
+    }
 
-        const auto scatter_pdf = res.mat->scatter_pdf(r, res, scattered);
+    // Position of p projected onto the image, in pixels.
+    auto screen_position(const vec3 &p) const -> vec2
+    {
+        const auto d = p - center;
+        const auto distance = -d.dot(w);
+        if (distance <= 0.f)
+            return vec2{};
+        const auto on_viewport = center + (focus_dist / distance) * d - pixel00_loc;
+        return vec2{on_viewport.dot(pixel_delta_u) / pixel_delta_u.magnitude_squared(), on_viewport.dot(pixel_delta_v) / pixel_delta_v.magnitude_squared()};
+    }
 
-        const auto sample_color = ray_color(scattered, depth - 1, w, lights);
-        const auto color_from_scatter = (sres.attenuation * scatter_pdf * sample_color) / pdf_value;
+    // How far a surface point seen at `time` moves across the image while the shutter is open.
+    auto screen_motion(const vec3 &p, const vec3 &velocity, float time) const -> vec2
+    {
+        if (velocity.near_zero())
+            return vec2{};
+        const auto open = screen_position(p - time * velocity);
+        const auto close = screen_position(p + (1.f - time) * velocity);
+        return vec2{close.x - open.x, close.y - open.y};
+    }
 
-        return color_from_emission + color_from_scatter;
+    static auto aov_path(const std::filesystem::path &path, aov a) -> std::filesystem::path
+    {
+        auto extension = path.extension();
+        if (extension != ".pfm" && extension != ".exr")
+            extension = ".exr";
+        auto result = path;
+        result.replace_extension();
+        result += ".";
+        result += aov_name(a);
+        result += extension;
+        return result;
     }
 
-    auto get_ray(std::size_t j, std::size_t i, std::size_t s_j, std::size_t s_i) const -> ray
+    auto get_ray(std::size_t j, std::size_t i, sampler &s) const -> ray
     {
-        auto offset = sample_square_stratified(s_j, s_i);
+        auto offset = sample_square(s);
         auto pixel_sample = pixel00_loc + ((j + offset.x) * pixel_delta_u) + ((i + offset.y) * pixel_delta_v);
 
-        auto ray_origin = (defocus_angle.radians <= 0.f) ? center : sample_defocus_disk();
+        auto ray_origin = (defocus_angle.radians <= 0.f) ? center : sample_defocus_disk(s);
         auto ray_direction = pixel_sample - ray_origin;
-        auto ray_time = randf();
+        auto ray_time = s.get_1d();
 
         return ray{ray_origin, ray_direction, ray_time};
     }
 
-    auto sample_square() const -> vec3
+    auto sample_square(sampler &s) const -> vec3
     {
-        return vec3{randf() - 0.5f, randf() - 0.5f, 0};
+        const auto u = s.get_2d();
+        return vec3{u.x - 0.5f, u.y - 0.5f, 0};
     }
 
-    auto sample_square_stratified(int s_j, int s_i) const -> vec3
+    auto sample_defocus_disk(sampler &s) const -> vec3
     {
-        const auto px = ((s_j + randf()) * recip_sqrt_spp) - 0.5f;
-        const auto py = ((s_i + randf()) * recip_sqrt_spp) - 0.5f;
-
-        return vec3{px, py, 0.f};
+        const auto p = vec3::concentric_disk(s.get_2d());
+        return center + (p.x * defocus_disk_u) + (p.y * defocus_disk_v);
     }
 
-    auto sample_defocus_disk() const -> vec3
+    // Brings every pixel of the film up to `sample_end` samples, or until it converges.
+    auto render_pass(film &accumulated, std::size_t sample_end, std::chrono::steady_clock::time_point deadline, const world &w, const world &lights, progress_reporter &progress, std::size_t thread_count) -> void
     {
-        const auto p = vec3::random_in_unit_disk();
-        return center + (p.x * defocus_disk_u) + (p.y * defocus_disk_v);
+        auto tiles = tile_queue{tile_queue::hilbert(image_width, image_height, tile_size)};
+        if (thread_count > 1)
+        {
+            std::vector<std::thread> threads;
+            for (std::size_t i = 0; i < thread_count; ++i)
+            {
+                threads.emplace_back([&, i]()
+                                     { render_thread(tiles, sample_end, deadline, w, lights, accumulated, progress.threads[i]); });
+            }
+            for (std::size_t i = 0; i < threads.size(); ++i)
+            {
+                threads[i].join();
+            }
+        }
+        else
+        {
+            render_thread(tiles, sample_end, deadline, w, lights, accumulated, progress.threads[0]);
+        }
     }
 
-    using time_point = decltype(std::chrono::high_resolution_clock::now());
-    using report_progress_fn = std::function<void(std::size_t thread_id, float percent_done)>;
-
-    auto render_thread(std::size_t thread_id, std::size_t num_threads, const world &w, const world &lights, image &img, report_progress_fn report_progress) -> void
+    auto render_thread(tile_queue &tiles, std::size_t sample_end, std::chrono::steady_clock::time_point deadline, const world &w, const world &lights, film &accumulated, thread_progress &progress) -> void
     {
-        std::string time_unit = "seconds";
+        auto pixel_sampler = make_sampler(sampling, seed);
 
-        const auto start_y_pixel = thread_id * img.height() / num_threads;
-        const auto end_y_pixel = (thread_id + 1) * img.height() / num_threads;
-        for (std::size_t i = start_y_pixel; i < end_y_pixel; ++i)
+        auto t = tile{};
+        while (!render_interrupted.load(std::memory_order_relaxed) && std::chrono::steady_clock::now() < deadline && tiles.pop(t))
         {
-            for (std::size_t j = 0; j < img.width(); ++j)
+            const auto stats = render_tile(t, sample_end, w, lights, *pixel_sampler, &accumulated.at(t.x0, t.y0), accumulated.width());
+            progress.add(stats.samples, stats.rays, stats.skipped);
+        }
+    }
+
+    // The most samples still to be taken over the whole image, counting none for converged pixels.
+    auto outstanding_samples(const film &accumulated) const -> std::uint64_t
+    {
+        const auto max_samples = max_samples_for_pixel();
+        auto total = std::uint64_t{0};
+        for (std::size_t y = 0; y < image_height; ++y)
+        {
+            for (std::size_t x = 0; x < image_width; ++x)
             {
-                auto pixel_color = color{0, 0, 0};
-                for (std::size_t s_i = 0; s_i < sqrt_spp; ++s_i)
-                {
-                    for (std::size_t s_j = 0; s_j < sqrt_spp; ++s_j)
-                    {
-                        const auto r = get_ray(j, i, s_j, s_i);
-                        pixel_color += ray_color(r, max_depth, w, lights);
-                    }
-                }
-                img.set_color(j, i, pixel_sample_scale * pixel_color);
+                const auto &estimate = accumulated.at(x, y);
+                if (!converged(estimate))
+                    total += max_samples - std::min<std::size_t>(estimate.samples, max_samples);
             }
-
-            report_progress(thread_id, static_cast<float>(start_y_pixel + i + 1) / end_y_pixel);
         }
+        return total;
+    }
+
+    auto converged(const pixel_estimate &estimate) const -> bool
+    {
+        return adaptive_sampling && estimate.samples >= min_samples_per_pixel && estimate.relative_error() < adaptive_target_error;
     }
 };
@@ -0,0 +1,177 @@
+#include "checkpoint.hpp"
+
+#include <bit>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr char checkpoint_magic[8] = {'R', 'T', 'W', 'C', 'K', 'P', 'T', '7'};
+
+    struct checkpoint_header
+    {
+        char magic[8];
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint64_t seed;
+        std::uint32_t sampling;
+        std::uint32_t max_samples;
+        std::uint32_t max_depth;
+        std::uint32_t adaptive;
+        std::uint32_t min_samples;
+        std::uint32_t target_error; // bits of the float, so it compares exactly
+        std::uint32_t pass_samples;
+        std::uint32_t features; // whether the feature section follows the pixels
+    };
+
+    // the part of a pixel_estimate that sampling depends on
+    struct checkpoint_pixel
+    {
+        float sum[3];
+        std::uint32_t samples;
+        float mean;
+        float m2;
+    };
+
+    struct checkpoint_features
+    {
+        surface_features features;
+        float albedo_squares;
+    };
+
+    static_assert(std::is_trivially_copyable_v<checkpoint_features>);
+
+    auto header_for(const film &accumulated, const checkpoint_settings &settings) -> checkpoint_header
+    {
+        auto header = checkpoint_header{};
+        std::memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+        header.width = static_cast<std::uint32_t>(accumulated.width());
+        header.height = static_cast<std::uint32_t>(accumulated.height());
+        header.seed = settings.seed;
+        header.sampling = static_cast<std::uint32_t>(settings.sampling);
+        header.max_samples = settings.max_samples;
+        header.max_depth = settings.max_depth;
+        header.adaptive = settings.adaptive ? 1 : 0;
+        header.min_samples = settings.min_samples;
+        header.target_error = std::bit_cast<std::uint32_t>(settings.target_error);
+        header.pass_samples = settings.pass_samples;
+        header.features = settings.features ? 1 : 0;
+        return header;
+    }
+
+    // Flushes the file's data to the disk, so a crash right after the rename cannot leave it empty.
+    auto sync_file(const std::filesystem::path &path) -> bool
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        const auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        const auto synced = ::fsync(fd) == 0;
+        ::close(fd);
+        return synced;
+#else
+        return true;
+#endif
+    }
+
+    auto on_interrupt(int) -> void
+    {
+        render_interrupted.store(true, std::memory_order_relaxed);
+    }
+}
+
+auto install_interrupt_handler() -> void
+{
+    std::signal(SIGTERM, on_interrupt);
+    std::signal(SIGINT, on_interrupt);
+}
+
+auto save_checkpoint(const std::filesystem::path &path, const film &accumulated, const checkpoint_settings &settings) -> bool
+{
+    const auto header = header_for(accumulated, settings);
+
+    // write next to the old checkpoint and swap it in, so an interrupted write never loses the last one
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        auto file = std::ofstream{temp_path, std::ios::binary | std::ios::trunc};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        auto pixels = std::vector<checkpoint_pixel>(accumulated.pixel_count());
+        for (std::size_t i = 0; i < pixels.size(); ++i)
+        {
+            const auto &p = accumulated.data()[i];
+            pixels[i] = checkpoint_pixel{{p.sum.x, p.sum.y, p.sum.z}, p.samples, p.mean, p.m2};
+        }
+        file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size() * sizeof(checkpoint_pixel));
+
+        if (settings.features)
+        {
+            auto features = std::vector<checkpoint_features>(accumulated.pixel_count());
+            for (std::size_t i = 0; i < features.size(); ++i)
+                features[i] = checkpoint_features{accumulated.data()[i].features, accumulated.data()[i].albedo_squares};
+            file.write(reinterpret_cast<const char *>(features.data()), features.size() * sizeof(checkpoint_features));
+        }
+        // closing flushes the buffered tail, which can fail too
+        file.close();
+        if (!file)
+            return false;
+    }
+    if (!sync_file(temp_path))
+        return false;
+
+    auto error = std::error_code{};
+    std::filesystem::rename(temp_path, path, error);
+    return !error;
+}
+
+auto load_checkpoint(const std::filesystem::path &path, film &accumulated, const checkpoint_settings &settings) -> bool
+{
+    auto file = std::ifstream{path, std::ios::binary};
+    auto header = checkpoint_header{};
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+    if (settings.features && !header.features)
+        return false;
+    // a checkpoint with features serves renders that do not need them
+    auto expected = header_for(accumulated, settings);
+    expected.features = header.features;
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0)
+        return false;
+
+    auto loaded = film{header.width, header.height};
+    auto pixels = std::vector<checkpoint_pixel>(loaded.pixel_count());
+    if (!file.read(reinterpret_cast<char *>(pixels.data()), pixels.size() * sizeof(checkpoint_pixel)))
+        return false;
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+    {
+        auto &p = loaded.data()[i];
+        p.sum = color{pixels[i].sum[0], pixels[i].sum[1], pixels[i].sum[2]};
+        p.samples = pixels[i].samples;
+        p.mean = pixels[i].mean;
+        p.m2 = pixels[i].m2;
+    }
+
+    if (settings.features)
+    {
+        auto features = std::vector<checkpoint_features>(loaded.pixel_count());
+        if (!file.read(reinterpret_cast<char *>(features.data()), features.size() * sizeof(checkpoint_features)))
+            return false;
+        for (std::size_t i = 0; i < features.size(); ++i)
+        {
+            loaded.data()[i].features = features[i].features;
+            loaded.data()[i].albedo_squares = features[i].albedo_squares;
+        }
+    }
+    accumulated = std::move(loaded);
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+#include "film.hpp"
+#include "sampler.hpp"
+
+// Set when the process is asked to terminate. Render threads stop taking tiles once it is set so the
+// camera can flush a checkpoint before exiting.
+inline std::atomic<bool> render_interrupted{false};
+
+// Sets render_interrupted on SIGTERM and SIGINT.
+auto install_interrupt_handler() -> void;
+
+// The render settings a checkpoint's estimates depend on. Resuming with any of them changed would
+// average samples of different images.
+struct checkpoint_settings
+{
+    std::uint64_t seed = 0;
+    sampler_type sampling = sampler_type::sobol;
+    std::uint32_t max_samples = 0; // samples per pixel, or the adaptive maximum
+    std::uint32_t max_depth = 0;
+    // which pixels count as converged, and at which sample counts they are tested
+    bool adaptive = false;
+    std::uint32_t min_samples = 0;
+    float target_error = 0.f;
+    std::uint32_t pass_samples = 0;
+    // whether the surface features are saved too, which only denoising and aovs need
+    bool features = false;
+};
+
+// A checkpoint is the settings plus the estimator state of every pixel: its sum, sample count and
+// Welford mean and m2, 24 bytes per pixel. The rng is reseeded from (seed, pixel, sample index) for
+// every sample, so the per-pixel sample counts are all the rng state a resumed render needs. The
+// surface features follow in a second section when settings.features is set. The file is written to
+// a temporary file that replaces the old checkpoint only once it is completely on disk.
+auto save_checkpoint(const std::filesystem::path &path, const film &accumulated, const checkpoint_settings &settings) -> bool;
+
+// Fails when the file is missing or unreadable, or was written for another resolution or settings,
+// or without the surface features that settings.features asks for. Features that are saved but not
+// asked for are skipped and left zero.
+auto load_checkpoint(const std::filesystem::path &path, film &accumulated, const checkpoint_settings &settings) -> bool;
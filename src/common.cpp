@@ -8,10 +8,10 @@ const auto aabb::universe = aabb{interval::universe, interval::universe, interva
 
 auto raytraceable_pdf::value(const vec3 &direction) const -> float
 {
-    return obj.pdf_value(origin, direction);
+    return obj->pdf_value(origin, direction);
 }
 
-auto raytraceable_pdf::generate() const -> vec3
+auto raytraceable_pdf::generate(sampler &s) const -> vec3
 {
-    return obj.random(origin);
+    return obj->random(origin, s);
 }
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <cmath>
-#include <random>
+#include <cstdint>
 #include <limits>
 #include <array>
 
@@ -12,12 +12,65 @@ constexpr auto radians_to_degrees = 180.0f / pi;
 
 constexpr auto is_nan(float n) { return n != n; }
 
-inline auto randf() -> float
+constexpr auto hash_u64(std::uint64_t x) -> std::uint64_t
 {
-    static std::uniform_real_distribution<float> distribution(0.f, 1.f);
-    static std::mt19937 generator;
-    return distribution(generator);
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
 }
+
+// Folds value into the running hash h; the result depends on the order values are folded in.
+constexpr auto hash_combine(std::uint64_t h, std::uint64_t value) -> std::uint64_t
+{
+    return hash_u64(h ^ hash_u64(value));
+}
+
+// PCG32 (pcg-random.org). Small enough to keep one per thread and cheap enough to reseed per sample.
+struct pcg32
+{
+    std::uint64_t state = 0x853c49e6748fea9bull;
+    std::uint64_t inc = 0xda3e39cb94b95bdbull;
+
+    static constexpr auto seeded(std::uint64_t seed, std::uint64_t stream = 0) -> pcg32
+    {
+        auto rng = pcg32{0u, (stream << 1u) | 1u};
+        rng.next_u32();
+        rng.state += seed;
+        rng.next_u32();
+        return rng;
+    }
+
+    constexpr auto next_u32() -> std::uint32_t
+    {
+        const auto old = state;
+        state = old * 6364136223846793005ull + inc;
+        const auto xorshifted = static_cast<std::uint32_t>(((old >> 18u) ^ old) >> 27u);
+        const auto rot = static_cast<std::uint32_t>(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+    }
+
+    // uniform in [0, 1)
+    constexpr auto next_float() -> float { return static_cast<float>(next_u32() >> 8) * 0x1p-24f; }
+};
+
+// Every thread owns its generator, so sampling never shares state between threads. The renderer
+// reseeds it per pixel sample, which makes the output independent of the thread count.
+inline auto thread_rng() -> pcg32 &
+{
+    thread_local pcg32 rng{};
+    return rng;
+}
+
+inline auto seed_thread_rng(std::uint64_t seed, std::uint64_t pixel_index, std::uint64_t sample_index) -> void
+{
+    thread_rng() = pcg32::seeded(hash_u64(seed ^ hash_u64(pixel_index)), sample_index);
+}
+
+inline auto randf() -> float { return thread_rng().next_float(); }
 inline auto randf(float min, float max) -> float { return min + (max - min) * randf(); }
 
 inline auto randi(int min, int max) -> int
@@ -28,6 +81,12 @@ inline auto randi(int min, int max) -> int
 template <typename type>
 constexpr auto lerp(type a, type b, float t) -> type { return a + t * (b - a); }
 
+struct vec2
+{
+    float x{};
+    float y{};
+};
+
 struct vec3;
 constexpr auto operator*(const float s, const vec3 &v) -> vec3;
 
@@ -71,6 +130,7 @@ struct vec3
     constexpr auto magnitude() const -> float { return sqrtf(magnitude_squared()); }
     constexpr auto normalized() const -> vec3 { return *this / magnitude(); }
     constexpr auto dot(const vec3 &v) const -> float { return x * v.x + y * v.y + z * v.z; }
+    constexpr auto max_component() const -> float { return std::max(x, std::max(y, z)); }
     constexpr auto cross(const vec3 &v) const -> vec3 { return {y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x}; }
 
     constexpr auto near_zero() const
@@ -95,10 +155,13 @@ struct vec3
 
     static auto random() -> vec3 { return {randf(), randf(), randf()}; }
     static auto random(float min, float max) -> vec3 { return {randf(min, max), randf(min, max), randf(min, max)}; }
-    static auto random_unit_vector() -> vec3
+    static auto random_unit_vector() -> vec3 { return unit_vector(vec2{randf(), randf()}); }
+
+    // maps a uniform point in [0, 1)^2 onto the unit sphere
+    static auto unit_vector(const vec2 &u) -> vec3
     {
-        const auto phi = randf(0, pi * 2);
-        const auto costheta = randf(-1, 1);
+        const auto phi = 2 * pi * u.x;
+        const auto costheta = 2 * u.y - 1;
         const auto theta = std::acosf(costheta);
         const auto x = std::sinf(theta) * std::cosf(phi);
         const auto y = std::sinf(theta) * std::sinf(phi);
@@ -126,10 +189,25 @@ struct vec3
         }
     }
 
-    static auto random_cosine_direction() -> vec3
+    // maps a uniform point in [0, 1)^2 onto the unit disk, keeping neighbouring points close
+    static auto concentric_disk(const vec2 &u) -> vec3
     {
-        const auto r1 = randf();
-        const auto r2 = randf();
+        const auto ox = 2 * u.x - 1;
+        const auto oy = 2 * u.y - 1;
+        if (ox == 0 && oy == 0)
+            return {0, 0, 0};
+
+        const auto r = std::fabsf(ox) > std::fabsf(oy) ? ox : oy;
+        const auto theta = std::fabsf(ox) > std::fabsf(oy) ? (pi / 4) * (oy / ox) : (pi / 2) - (pi / 4) * (ox / oy);
+        return {r * std::cosf(theta), r * std::sinf(theta), 0};
+    }
+
+    static auto random_cosine_direction() -> vec3 { return cosine_direction(vec2{randf(), randf()}); }
+
+    static auto cosine_direction(const vec2 &u) -> vec3
+    {
+        const auto r1 = u.x;
+        const auto r2 = u.y;
 
         const auto phi = 2 * pi * r1;
         const auto sqrt_r2 = std::sqrtf(r2);
@@ -162,68 +240,8 @@ struct onb
     auto transform(const vec3 &v) const -> vec3 { return (v.x * axis[0]) + (v.y * axis[1]) + (v.z * axis[2]); }
 };
 
-struct pdf
-{
-    virtual ~pdf() {}
-    virtual auto value(const vec3 &direction) const -> float = 0;
-    virtual auto generate() const -> vec3 = 0;
-};
-
-struct sphere_pdf : pdf
-{
-    sphere_pdf() {}
-    auto value(const vec3 &direction) const -> float { return 1.f / (4.f * pi); }
-    auto generate() const -> vec3 { return vec3::random_unit_vector(); }
-};
-
-struct cosine_pdf : pdf
-{
-    onb uvw;
-
-    cosine_pdf(const vec3 &w) : uvw{w} {}
-
-    auto value(const vec3 &direction) const -> float override
-    {
-        const auto cosine_theta = direction.normalized().dot(uvw.w());
-        return std::fmaxf(0.f, cosine_theta / pi);
-    }
-
-    auto generate() const -> vec3 override
-    {
-        return uvw.transform(vec3::random_cosine_direction());
-    }
-};
-
-struct raytraceable;
-struct raytraceable_pdf : pdf
-{
-    const raytraceable& obj;
-    vec3 origin;
-
-    raytraceable_pdf(const raytraceable& obj, const vec3& origin) : obj{obj}, origin{origin} {}
-
-    auto value(const vec3& direction) const -> float override;
-    auto generate() const -> vec3 override;
-};
-
-struct mixture_pdf : pdf
-{
-    std::array<std::shared_ptr<pdf>, 2> p;
-
-    mixture_pdf(std::shared_ptr<pdf> p1, std::shared_ptr<pdf> p2) : p{p1, p2} {}
-
-    auto value(const vec3& direction) const -> float override
-    {
-        return 0.5f * p[0]->value(direction) + 0.5f * p[1]->value(direction);
-    }
-
-    auto generate() const -> vec3 override
-    {
-        if (randf() < 0.5f)
-            return p[0]->generate();
-        return p[1]->generate();
-    }
-};
+// Rec. 709 relative luminance of a linear color.
+constexpr auto luminance(const color &c) -> float { return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; }
 
 constexpr auto
 linear_to_gamma(float linear) -> float
@@ -366,6 +384,16 @@ struct aabb
         return true;
     }
 
+    constexpr auto centroid() const -> vec3
+    {
+        return vec3{(x.min + x.max) / 2.f, (y.min + y.max) / 2.f, (z.min + z.max) / 2.f};
+    }
+
+    constexpr auto surface_area() const -> float
+    {
+        return 2.f * (x.size() * y.size() + y.size() * z.size() + z.size() * x.size());
+    }
+
     constexpr auto longest_axis() const -> int
     {
         if (x.size() > y.size())
@@ -400,3 +428,93 @@ constexpr auto operator+(const vec3 &offset, const aabb &bbox) -> aabb
 {
     return bbox + offset;
 }
+
+// 3x4 affine transform: a 3x3 linear part with the translation in the last column. a * b applies b first.
+struct affine
+{
+    std::array<std::array<float, 4>, 3> m{{{1.f, 0.f, 0.f, 0.f}, {0.f, 1.f, 0.f, 0.f}, {0.f, 0.f, 1.f, 0.f}}};
+
+    static constexpr auto identity() -> affine { return {}; }
+
+    static constexpr auto translation(const vec3 &offset) -> affine
+    {
+        return {{{{1.f, 0.f, 0.f, offset.x}, {0.f, 1.f, 0.f, offset.y}, {0.f, 0.f, 1.f, offset.z}}}};
+    }
+
+    static constexpr auto scaling(const vec3 &s) -> affine
+    {
+        return {{{{s.x, 0.f, 0.f, 0.f}, {0.f, s.y, 0.f, 0.f}, {0.f, 0.f, s.z, 0.f}}}};
+    }
+
+    // same sense as rotate_y
+    static auto rotation_y(angle a) -> affine
+    {
+        const auto s = std::sinf(a.radians);
+        const auto c = std::cosf(a.radians);
+        return {{{{c, 0.f, s, 0.f}, {0.f, 1.f, 0.f, 0.f}, {-s, 0.f, c, 0.f}}}};
+    }
+
+    constexpr auto operator*(const affine &b) const -> affine
+    {
+        auto r = affine{};
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+                r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j] + (j == 3 ? m[i][3] : 0.f);
+        }
+        return r;
+    }
+
+    constexpr auto point(const vec3 &p) const -> vec3 { return vector(p) + vec3{m[0][3], m[1][3], m[2][3]}; }
+
+    constexpr auto vector(const vec3 &v) const -> vec3
+    {
+        return {m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z};
+    }
+
+    // Multiplies by the transposed linear part. On the inverse transform this maps normals the other way.
+    constexpr auto transposed_vector(const vec3 &v) const -> vec3
+    {
+        return {m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z};
+    }
+
+    constexpr auto inverse() const -> affine
+    {
+        const auto det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                         m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                         m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        const auto inv_det = 1.f / det;
+
+        auto r = affine{};
+        r.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+        r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+        r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+        r.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+        r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+        r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+        r.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+        r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+        r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+        const auto t = r.vector(vec3{m[0][3], m[1][3], m[2][3]});
+        r.m[0][3] = -t.x;
+        r.m[1][3] = -t.y;
+        r.m[2][3] = -t.z;
+        return r;
+    }
+
+    // box around the transformed corners of bbox
+    auto bounds(const aabb &bbox) const -> aabb
+    {
+        auto box = aabb::empty;
+        for (int i = 0; i < 8; ++i)
+        {
+            const auto corner = point(vec3{i & 1 ? bbox.x.max : bbox.x.min, i & 2 ? bbox.y.max : bbox.y.min, i & 4 ? bbox.z.max : bbox.z.min});
+            box = aabb::from_aabbs(box, aabb::from_points(corner, corner));
+        }
+        return box;
+    }
+};
@@ -0,0 +1,247 @@
+#include "denoiser.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr auto kernel = std::array{1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+    constexpr auto variance_kernel = std::array{1.f / 4.f, 1.f / 2.f, 1.f / 4.f};
+    constexpr auto albedo_floor = 1e-3f;      // darker albedo channels are left in the lighting
+    constexpr auto albedo_max_deviation = 0.05f; // relative spread across a pixel's samples above which the albedo is left in
+
+    // Lighting and its variance as separate planes, so the taps of one kernel row read contiguous floats.
+    struct signal
+    {
+        std::vector<float> r, g, b, variance;
+
+        explicit signal(std::size_t count) : r(count), g(count), b(count), variance(count) {}
+
+        auto luminance_at(std::size_t i) const -> float { return luminance(color{r[i], g[i], b[i]}); }
+    };
+
+    struct guides
+    {
+        std::vector<float> nx, ny, nz, depth, depth_gradient;
+        std::vector<std::uint8_t> covered; // the pixel has samples
+
+        explicit guides(std::size_t count) : nx(count), ny(count), nz(count), depth(count), depth_gradient(count), covered(count) {}
+    };
+
+    // Calls rows(y0, y1) on bands of rows spread over thread_count threads.
+    template <typename F>
+    auto for_rows(std::size_t height, std::size_t thread_count, const F &rows) -> void
+    {
+        thread_count = std::clamp<std::size_t>(thread_count, 1, std::max<std::size_t>(height, 1));
+        if (thread_count == 1)
+        {
+            rows(std::size_t{0}, height);
+            return;
+        }
+        const auto band = (height + thread_count - 1) / thread_count;
+        std::vector<std::thread> threads;
+        for (std::size_t y0 = 0; y0 < height; y0 += band)
+        {
+            threads.emplace_back([&, y0]()
+                                 { rows(y0, std::min(y0 + band, height)); });
+        }
+        for (auto &t : threads)
+            t.join();
+    }
+
+    auto finite_or_zero(float v) -> float { return std::isfinite(v) ? v : 0.f; }
+
+    // Smallest one-sided difference along each axis, so pixels next to a silhouette keep the gradient
+    // of their own surface.
+    auto depth_gradient(const guides &g, std::size_t width, std::size_t height, std::size_t x, std::size_t y) -> float
+    {
+        const auto p = y * width + x;
+        auto axis = [&](bool has_prev, std::size_t prev, bool has_next, std::size_t next)
+        {
+            auto d = infinity;
+            if (has_prev && g.covered[prev])
+                d = std::fabs(g.depth[p] - g.depth[prev]);
+            if (has_next && g.covered[next])
+                d = std::min(d, std::fabs(g.depth[next] - g.depth[p]));
+            return d == infinity ? 0.f : d;
+        };
+        const auto gx = axis(x > 0, p - 1, x + 1 < width, p + 1);
+        const auto gy = axis(y > 0, p - width, y + 1 < height, p + width);
+        return std::sqrt(gx * gx + gy * gy);
+    }
+
+    auto smooth_variance(const signal &in, const guides &g, std::size_t width, std::size_t height, std::size_t y0, std::size_t y1, std::vector<float> &out) -> void
+    {
+        for (auto y = y0; y < y1; ++y)
+        {
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                auto sum = 0.f;
+                auto weight_sum = 0.f;
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    const auto qy = static_cast<std::ptrdiff_t>(y) + dy;
+                    if (qy < 0 || qy >= static_cast<std::ptrdiff_t>(height))
+                        continue;
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        const auto qx = static_cast<std::ptrdiff_t>(x) + dx;
+                        if (qx < 0 || qx >= static_cast<std::ptrdiff_t>(width))
+                            continue;
+                        const auto q = static_cast<std::size_t>(qy) * width + static_cast<std::size_t>(qx);
+                        if (!g.covered[q])
+                            continue;
+                        const auto w = variance_kernel[dx + 1] * variance_kernel[dy + 1];
+                        sum += w * in.variance[q];
+                        weight_sum += w;
+                    }
+                }
+                out[y * width + x] = weight_sum > 0.f ? sum / weight_sum : 0.f;
+            }
+        }
+    }
+
+    // One à-trous iteration with taps `step` pixels apart.
+    auto filter_rows(const signal &in, const std::vector<float> &smoothed_variance, const guides &g, const denoise_settings &settings, std::size_t step, std::size_t width, std::size_t height, std::size_t y0, std::size_t y1, signal &out) -> void
+    {
+        const auto center_weight = kernel[2] * kernel[2];
+        for (auto y = y0; y < y1; ++y)
+        {
+            for (std::size_t x = 0; x < width; ++x)
+            {
+                const auto p = y * width + x;
+                if (!g.covered[p])
+                {
+                    out.r[p] = out.g[p] = out.b[p] = out.variance[p] = 0.f;
+                    continue;
+                }
+
+                const auto lp = in.luminance_at(p);
+                const auto luminance_scale = 1.f / (settings.sigma_luminance * std::sqrt(std::max(smoothed_variance[p], 0.f)) + 1e-6f);
+                const auto depth_scale = settings.sigma_depth * g.depth_gradient[p] * step;
+
+                auto weight_sum = center_weight;
+                auto r = center_weight * in.r[p];
+                auto gr = center_weight * in.g[p];
+                auto b = center_weight * in.b[p];
+                auto variance = center_weight * center_weight * in.variance[p];
+
+                for (int dy = -2; dy <= 2; ++dy)
+                {
+                    const auto qy = static_cast<std::ptrdiff_t>(y) + dy * static_cast<std::ptrdiff_t>(step);
+                    if (qy < 0 || qy >= static_cast<std::ptrdiff_t>(height))
+                        continue;
+                    for (int dx = -2; dx <= 2; ++dx)
+                    {
+                        const auto qx = static_cast<std::ptrdiff_t>(x) + dx * static_cast<std::ptrdiff_t>(step);
+                        if ((dx == 0 && dy == 0) || qx < 0 || qx >= static_cast<std::ptrdiff_t>(width))
+                            continue;
+                        const auto q = static_cast<std::size_t>(qy) * width + static_cast<std::size_t>(qx);
+                        if (!g.covered[q])
+                            continue;
+
+                        const auto cos_normal = g.nx[p] * g.nx[q] + g.ny[p] * g.ny[q] + g.nz[p] * g.nz[q];
+                        if (cos_normal <= 0.f)
+                            continue;
+                        const auto distance = std::sqrt(static_cast<float>(dx * dx + dy * dy));
+                        const auto luminance_error = std::fabs(lp - in.luminance_at(q)) * luminance_scale;
+                        const auto depth_error = std::fabs(g.depth[p] - g.depth[q]) / (depth_scale * distance + 1e-6f);
+                        const auto w = kernel[dx + 2] * kernel[dy + 2] * std::pow(cos_normal, settings.sigma_normal) * std::exp(-(luminance_error + depth_error));
+
+                        weight_sum += w;
+                        r += w * in.r[q];
+                        gr += w * in.g[q];
+                        b += w * in.b[q];
+                        variance += w * w * in.variance[q];
+                    }
+                }
+
+                out.r[p] = r / weight_sum;
+                out.g[p] = gr / weight_sum;
+                out.b[p] = b / weight_sum;
+                out.variance[p] = variance / (weight_sum * weight_sum);
+            }
+        }
+    }
+}
+
+auto denoise_film(const film &accumulated, const denoise_settings &settings, std::size_t thread_count) -> hdr_image
+{
+    const auto width = accumulated.width();
+    const auto height = accumulated.height();
+    const auto count = accumulated.pixel_count();
+
+    // split every pixel into albedo and lighting, and gather the guides
+    auto modulation = std::vector<color>(count);
+    auto current = signal{count};
+    auto g = guides{count};
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto &estimate = accumulated.data()[i];
+        if (estimate.samples == 0)
+            continue;
+
+        // Dividing by an albedo that varies between samples would multiply that variation back in as
+        // noise, so only pixels that saw a single surface color are split.
+        const auto f = estimate.feature_value();
+        const auto albedo_luminance = luminance(f.albedo);
+        const auto uniform_albedo = estimate.albedo_variance() <= albedo_max_deviation * albedo_max_deviation * albedo_luminance * albedo_luminance;
+        auto &m = modulation[i];
+        for (int c = 0; c < 3; ++c)
+            m.data[c] = uniform_albedo && f.albedo.data[c] > albedo_floor ? f.albedo.data[c] : 1.f;
+
+        const auto value = estimate.value();
+        current.r[i] = finite_or_zero(value.r) / m.r;
+        current.g[i] = finite_or_zero(value.g) / m.g;
+        current.b[i] = finite_or_zero(value.b) / m.b;
+
+        // the estimate tracks the variance of the pixel's luminance, scaled here to the lighting
+        const auto luminance_scale = 1.f / luminance(m);
+        if (estimate.samples > 1)
+            current.variance[i] = finite_or_zero(estimate.m2 / (estimate.samples - 1) / estimate.samples) * luminance_scale * luminance_scale;
+        else
+            current.variance[i] = current.luminance_at(i) * current.luminance_at(i);
+
+        const auto length = f.normal.magnitude();
+        if (length > 0.f)
+        {
+            g.nx[i] = f.normal.x / length;
+            g.ny[i] = f.normal.y / length;
+            g.nz[i] = f.normal.z / length;
+        }
+        g.depth[i] = f.depth;
+        g.covered[i] = 1;
+    }
+    for (std::size_t y = 0; y < height; ++y)
+    {
+        for (std::size_t x = 0; x < width; ++x)
+            g.depth_gradient[y * width + x] = depth_gradient(g, width, height, x, y);
+    }
+
+    auto next = signal{count};
+    auto smoothed_variance = std::vector<float>(count);
+    for (std::size_t iteration = 0; iteration < settings.iterations; ++iteration)
+    {
+        const auto step = std::size_t{1} << iteration;
+        for_rows(height, thread_count, [&](std::size_t y0, std::size_t y1)
+                 { smooth_variance(current, g, width, height, y0, y1, smoothed_variance); });
+        for_rows(height, thread_count, [&](std::size_t y0, std::size_t y1)
+                 { filter_rows(current, smoothed_variance, g, settings, step, width, height, y0, y1, next); });
+        std::swap(current, next);
+    }
+
+    auto img = hdr_image{width, height};
+    for (std::size_t y = 0; y < height; ++y)
+    {
+        for (std::size_t x = 0; x < width; ++x)
+        {
+            const auto i = y * width + x;
+            img.set_color(x, y, modulation[i] * color{current.r[i], current.g[i], current.b[i]});
+        }
+    }
+    return img;
+}
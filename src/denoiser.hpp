@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+#include "film.hpp"
+#include "image.hpp"
+
+// Edge-avoiding à-trous wavelet filter (Dammertz et al. 2010) with the variance-guided luminance
+// weight of SVGF (Schied et al. 2017). Each iteration applies a 5x5 B3 spline kernel whose taps are
+// spaced twice as far apart as the previous iteration's. Taps are weighted down when their normal,
+// depth or luminance differ from the center pixel by more than the noise explains. The filter works on
+// lighting with the albedo divided out and multiplies it back in at the end, so texture stays sharp.
+struct denoise_settings
+{
+    std::size_t iterations = 5;   // the filter reaches 2 * (2^iterations - 1) pixels out
+    float sigma_luminance = 4.f;  // in standard deviations of the pixel's estimated luminance
+    float sigma_normal = 128.f;   // exponent on the cosine between normals
+    float sigma_depth = 1.f;      // relative to the local depth gradient
+};
+
+auto denoise_film(const film &accumulated, const denoise_settings &settings, std::size_t thread_count) -> hdr_image;
@@ -0,0 +1,450 @@
+#include "distributed.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <print>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RTW_POSIX_SOCKETS 1
+#include <cerrno>
+#include <csignal>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#if defined(RTW_POSIX_SOCKETS)
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    // All messages are fixed size little endian structs, so every node must be a little endian host.
+    constexpr std::uint32_t protocol_magic = 0x36575452; // "RTW6"
+
+    enum class message_op : std::uint32_t
+    {
+        render = 1,
+        finish = 2,
+    };
+
+    // worker -> coordinator, once after connecting
+    struct worker_hello
+    {
+        std::uint32_t magic;
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t sampling;
+        std::uint64_t seed;
+        std::uint32_t max_depth;
+        std::uint32_t pad;
+        std::uint64_t scene;             // the scene_hash the process was started with
+        std::uint64_t sampling_settings; // hash of the sample budget, adaptive and roulette settings
+    };
+
+    auto sampling_settings_hash(const camera &cam) -> std::uint64_t
+    {
+        auto h = std::uint64_t{0};
+        h = hash_combine(h, cam.samples_per_pixel);
+        h = hash_combine(h, cam.adaptive_sampling);
+        h = hash_combine(h, cam.min_samples_per_pixel);
+        h = hash_combine(h, cam.max_samples_per_pixel);
+        h = hash_combine(h, std::bit_cast<std::uint32_t>(cam.adaptive_target_error));
+        h = hash_combine(h, cam.russian_roulette);
+        h = hash_combine(h, cam.russian_roulette_min_depth);
+        return h;
+    }
+
+    // Everything a worker's samples depend on. The scene itself is built by every process, so it is
+    // compared by the hash of whatever chose it.
+    auto hello_for(const camera &cam, std::size_t width, std::size_t height, std::uint64_t scene_hash) -> worker_hello
+    {
+        return worker_hello{protocol_magic, static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height), static_cast<std::uint32_t>(cam.sampling), cam.seed, static_cast<std::uint32_t>(cam.max_depth), 0, scene_hash, sampling_settings_hash(cam)};
+    }
+
+    // coordinator -> worker
+    struct tile_assignment
+    {
+        message_op op;
+        std::uint32_t tile_index;
+        std::uint32_t x0, y0, x1, y1;
+        std::uint32_t sample_end;
+        std::uint32_t pad;
+    };
+
+    // worker -> coordinator, followed by pixel_count pixel_estimates in row order
+    struct tile_result
+    {
+        std::uint32_t tile_index;
+        std::uint32_t pixel_count;
+        std::uint64_t samples;
+        std::uint64_t rays;
+    };
+
+    auto send_all(int fd, const void *data, std::size_t size) -> bool
+    {
+        const auto *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            const auto sent = ::send(fd, bytes, size, 0);
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= static_cast<std::size_t>(sent);
+        }
+        return true;
+    }
+
+    auto recv_all(int fd, void *data, std::size_t size) -> bool
+    {
+        auto *bytes = static_cast<char *>(data);
+        while (size > 0)
+        {
+            const auto received = ::recv(fd, bytes, size, 0);
+            if (received <= 0)
+                return false;
+            bytes += received;
+            size -= static_cast<std::size_t>(received);
+        }
+        return true;
+    }
+
+    template <typename T>
+    auto send_value(int fd, const T &value) -> bool { return send_all(fd, &value, sizeof(T)); }
+
+    template <typename T>
+    auto recv_value(int fd, T &value) -> bool { return recv_all(fd, &value, sizeof(T)); }
+
+    auto listen_on(std::uint16_t port) -> int
+    {
+        const auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        const int enable = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        auto address = sockaddr_in{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        if (::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || ::listen(fd, 64) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    auto connect_to(const std::string &host, std::uint16_t port) -> int
+    {
+        auto hints = addrinfo{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *addresses = nullptr;
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+            return -1;
+
+        auto fd = -1;
+        for (auto *a = addresses; a != nullptr && fd < 0; a = a->ai_next)
+        {
+            fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        ::freeaddrinfo(addresses);
+        return fd;
+    }
+
+    auto configure_connection(int fd) -> void
+    {
+        const int enable = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+
+    struct worker_connection
+    {
+        int fd = -1;
+        bool ready = false; // hello received
+        std::optional<std::size_t> current{};
+        std::vector<char> inbox{}; // received bytes of messages that are not complete yet
+    };
+
+    // Appends whatever the socket has buffered to the worker's inbox without waiting for more, so a
+    // worker that stalls in the middle of a message never blocks the coordinator. Returns false once
+    // the connection is closed or failed.
+    auto receive_available(worker_connection &worker) -> bool
+    {
+        char buffer[64 * 1024];
+        while (true)
+        {
+            const auto received = ::recv(worker.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (received > 0)
+            {
+                worker.inbox.insert(std::end(worker.inbox), buffer, buffer + received);
+                continue;
+            }
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return true;
+            return false;
+        }
+    }
+
+    auto worker_thread(const camera &cam, const world &w, const world &lights, const std::string &host, std::uint16_t port, std::uint64_t scene_hash) -> bool
+    {
+        const auto fd = connect_to(host, port);
+        if (fd < 0)
+            return false;
+        configure_connection(fd);
+
+        auto width = std::size_t{0};
+        auto height = std::size_t{0};
+        cam.image_size(width, height);
+        const auto hello = hello_for(cam, width, height, scene_hash);
+        auto ok = send_value(fd, hello);
+
+        auto pixel_sampler = make_sampler(cam.sampling, cam.seed);
+        auto pixels = std::vector<pixel_estimate>{};
+        auto assignment = tile_assignment{};
+        while (ok && recv_value(fd, assignment) && assignment.op == message_op::render)
+        {
+            const auto t = tile{assignment.x0, assignment.y0, assignment.x1, assignment.y1};
+            pixels.assign(t.pixel_count(), pixel_estimate{});
+            const auto stats = cam.render_tile(t, assignment.sample_end, w, lights, *pixel_sampler, pixels.data(), t.x1 - t.x0);
+
+            const auto result = tile_result{assignment.tile_index, static_cast<std::uint32_t>(pixels.size()), stats.samples, stats.rays};
+            ok = send_value(fd, result) && send_all(fd, pixels.data(), pixels.size() * sizeof(pixel_estimate));
+        }
+        ::close(fd);
+        return ok && assignment.op == message_op::finish;
+    }
+}
+
+auto run_coordinator(camera &cam, const coordinator_options &options, const std::filesystem::path &path) -> bool
+{
+    std::signal(SIGPIPE, SIG_IGN);
+    const auto listen_fd = listen_on(options.port);
+    if (listen_fd < 0)
+    {
+        std::println("could not listen on port {}", options.port);
+        return false;
+    }
+
+    auto accumulated = cam.make_film();
+    const auto tiles = tile_queue::hilbert(accumulated.width(), accumulated.height(), cam.tile_size);
+    const auto sample_end = static_cast<std::uint32_t>(cam.max_samples_for_pixel());
+    std::println("coordinating {}x{} image in {} tiles on port {}", accumulated.width(), accumulated.height(), tiles.size(), options.port);
+
+    auto pending = std::deque<std::size_t>{};
+    for (std::size_t i = 0; i < tiles.size(); ++i)
+        pending.push_back(i);
+    auto finished = std::vector<bool>(tiles.size(), false);
+    auto issued_at = std::vector<clock::time_point>(tiles.size());
+    auto remaining = tiles.size();
+
+    auto workers = std::vector<worker_connection>{};
+    auto total = tile_stats{};
+    const auto start = clock::now();
+    auto last_report = start;
+
+    // the next tile for an idle worker: a queued one, or else the longest outstanding overdue one
+    const auto next_tile = [&]() -> std::optional<std::size_t>
+    {
+        while (!pending.empty())
+        {
+            const auto index = pending.front();
+            pending.pop_front();
+            if (!finished[index])
+                return index;
+        }
+        std::optional<std::size_t> overdue{};
+        for (const auto &worker : workers)
+        {
+            if (worker.current && !finished[*worker.current] && clock::now() - issued_at[*worker.current] > options.tile_timeout && (!overdue || issued_at[*worker.current] < issued_at[*overdue]))
+                overdue = worker.current;
+        }
+        return overdue;
+    };
+
+    // Processes the complete messages in the worker's inbox and keeps the rest for later. Returns
+    // false when the worker broke the protocol.
+    const auto handle_messages = [&](worker_connection &worker) -> bool
+    {
+        auto consumed = std::size_t{0};
+        const auto available = [&]()
+        { return worker.inbox.size() - consumed; };
+        while (true)
+        {
+            if (!worker.ready)
+            {
+                if (available() < sizeof(worker_hello))
+                    break;
+                auto hello = worker_hello{};
+                std::memcpy(&hello, worker.inbox.data() + consumed, sizeof(hello));
+                const auto expected = hello_for(cam, accumulated.width(), accumulated.height(), options.scene_hash);
+                if (std::memcmp(&hello, &expected, sizeof(hello)) != 0)
+                {
+                    std::println("rejected a worker with a different protocol, resolution or render settings");
+                    return false;
+                }
+                consumed += sizeof(hello);
+                worker.ready = true;
+                continue;
+            }
+
+            if (available() < sizeof(tile_result))
+                break;
+            auto result = tile_result{};
+            std::memcpy(&result, worker.inbox.data() + consumed, sizeof(result));
+            // checked before the pixels arrive, so the inbox never grows past one tile
+            if (!worker.current || result.tile_index != *worker.current || result.pixel_count != tiles[result.tile_index].pixel_count())
+                return false;
+            const auto pixel_bytes = result.pixel_count * sizeof(pixel_estimate);
+            if (available() < sizeof(result) + pixel_bytes)
+                break;
+            const auto *pixel_data = worker.inbox.data() + consumed + sizeof(result);
+            consumed += sizeof(result) + pixel_bytes;
+
+            worker.current.reset();
+            if (finished[result.tile_index])
+                continue; // a reissued tile that came back twice
+            finished[result.tile_index] = true;
+            --remaining;
+            total.samples += result.samples;
+            total.rays += result.rays;
+
+            const auto &t = tiles[result.tile_index];
+            const auto row_bytes = (t.x1 - t.x0) * sizeof(pixel_estimate);
+            for (auto y = t.y0; y < t.y1; ++y)
+                std::memcpy(&accumulated.at(t.x0, y), pixel_data + (y - t.y0) * row_bytes, row_bytes);
+        }
+        worker.inbox.erase(std::begin(worker.inbox), std::begin(worker.inbox) + static_cast<std::ptrdiff_t>(consumed));
+        return true;
+    };
+
+    const auto drop = [&](worker_connection &worker)
+    {
+        if (worker.current && !finished[*worker.current])
+            pending.push_front(*worker.current);
+        worker.current.reset();
+        ::close(worker.fd);
+        worker.fd = -1;
+    };
+
+    while (remaining > 0 && !render_interrupted.load(std::memory_order_relaxed))
+    {
+        for (auto &worker : workers)
+        {
+            if (!worker.ready || worker.current)
+                continue;
+            const auto index = next_tile();
+            if (!index)
+                break;
+            const auto &t = tiles[*index];
+            const auto assignment = tile_assignment{message_op::render, static_cast<std::uint32_t>(*index), static_cast<std::uint32_t>(t.x0), static_cast<std::uint32_t>(t.y0), static_cast<std::uint32_t>(t.x1), static_cast<std::uint32_t>(t.y1), sample_end, 0};
+            worker.current = *index;
+            issued_at[*index] = clock::now();
+            if (!send_value(worker.fd, assignment))
+                drop(worker);
+        }
+        std::erase_if(workers, [](const worker_connection &worker)
+                      { return worker.fd < 0; });
+
+        auto fds = std::vector<pollfd>{};
+        fds.push_back(pollfd{listen_fd, POLLIN, 0});
+        for (const auto &worker : workers)
+            fds.push_back(pollfd{worker.fd, POLLIN, 0});
+        if (::poll(fds.data(), fds.size(), 100) < 0)
+            continue;
+
+        if (fds[0].revents & POLLIN)
+        {
+            const auto fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd >= 0)
+            {
+                configure_connection(fd);
+                workers.push_back(worker_connection{fd});
+            }
+        }
+
+        for (std::size_t i = 1; i < fds.size(); ++i)
+        {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            auto &worker = workers[i - 1];
+            const auto open = receive_available(worker);
+            if (!handle_messages(worker) || !open)
+                drop(worker);
+        }
+        std::erase_if(workers, [](const worker_connection &worker)
+                      { return worker.fd < 0; });
+
+        if (clock::now() - last_report >= options.report_interval)
+        {
+            last_report = clock::now();
+            const auto elapsed = std::chrono::duration<float>(last_report - start).count();
+            std::println("{:.1f}% of tiles, {} workers, {:.2f}M rays/s", 100.f * (tiles.size() - remaining) / tiles.size(), workers.size(), total.rays / elapsed * 1e-6f);
+        }
+    }
+
+    for (auto &worker : workers)
+    {
+        send_value(worker.fd, tile_assignment{message_op::finish, 0, 0, 0, 0, 0, 0, 0});
+        ::close(worker.fd);
+    }
+    ::close(listen_fd);
+
+    // the workers are done, so a denoise pass can have every core here
+    cam.write_output(accumulated, path, std::max(std::thread::hardware_concurrency(), 1u));
+    const auto elapsed = std::chrono::duration<float>(clock::now() - start).count();
+    std::println("finished in {:.1f}s, {:.2f}M rays/s over all workers, output at {}", elapsed, total.rays / elapsed * 1e-6f, path.string());
+    return remaining == 0;
+}
+
+auto run_worker(camera &cam, const world &w, const world &lights, const std::string &host, std::uint16_t port, std::size_t connections, std::uint64_t scene_hash) -> bool
+{
+    std::signal(SIGPIPE, SIG_IGN);
+    cam.prepare(); // before the threads share the camera
+
+    connections = std::max<std::size_t>(connections, 1);
+    auto results = std::vector<char>(connections, 0);
+    auto threads = std::vector<std::thread>{};
+    for (std::size_t i = 0; i < connections; ++i)
+    {
+        threads.emplace_back([&, i]()
+                             { results[i] = worker_thread(cam, w, lights, host, port, scene_hash); });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    const auto ok = std::all_of(std::begin(results), std::end(results), [](char r)
+                                { return r != 0; });
+    if (!ok)
+        std::println("lost the connection to {}:{}", host, port);
+    return ok;
+}
+
+#else
+
+auto run_coordinator(camera &cam, const coordinator_options &options, const std::filesystem::path &path) -> bool
+{
+    std::println("distributed rendering needs POSIX sockets");
+    return false;
+}
+
+auto run_worker(camera &cam, const world &w, const world &lights, const std::string &host, std::uint16_t port, std::size_t connections, std::uint64_t scene_hash) -> bool
+{
+    std::println("distributed rendering needs POSIX sockets");
+    return false;
+}
+
+#endif
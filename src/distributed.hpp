@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "camera.hpp"
+#include "raytraceable.hpp"
+
+// Splits one frame across processes. The coordinator listens on a TCP port and hands out tiles. Each
+// worker connection renders one tile at a time and sends back the tile's pixel estimates. Every
+// process builds the same scene itself, and the coordinator only accepts workers started with the
+// same scene_hash, which the caller derives from whatever chose the scene, and whose camera has the
+// same resolution, seed, sampler, max depth, sample budget, adaptive and Russian roulette settings. Because samples are seeded by pixel and sample index, the merged
+// frame is identical to a single process render.
+//
+// Tiles held by a worker that disconnects go back to the queue, and once the queue is empty, tiles
+// outstanding for longer than tile_timeout are handed to idle workers as well. Only available on
+// POSIX systems; elsewhere both functions report that and return false.
+
+struct coordinator_options
+{
+    std::uint16_t port = 7878;
+    std::chrono::seconds tile_timeout{120};
+    std::chrono::milliseconds report_interval{1000};
+    std::uint64_t scene_hash = 0;
+};
+
+auto run_coordinator(camera &cam, const coordinator_options &options, const std::filesystem::path &path) -> bool;
+
+// Opens `connections` connections to the coordinator, each served by its own render thread, and
+// returns once the coordinator has finished the frame.
+auto run_worker(camera &cam, const world &w, const world &lights, const std::string &host, std::uint16_t port, std::size_t connections, std::uint64_t scene_hash = 0) -> bool;
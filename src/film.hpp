@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+#include "hit_result.hpp"
+#include "image.hpp"
+
+// Surface properties seen by a camera sample. The denoiser uses them to tell edges from noise, and
+// they are written out as arbitrary output variables. They are taken at the first surface that is not
+// a mirror or glass, so reflections and refractions get the properties of what they show.
+struct surface_features
+{
+    color albedo{0, 0, 0};
+    vec3 normal{0, 0, 0}; // zero for samples that leave the scene
+    float depth = 0.f;    // path length from the camera, zero for samples that leave the scene
+    vec2 motion{};        // in pixels from shutter open to close
+    material_id mat = no_material;
+    primitive_id prim = no_primitive;
+    primitive_id instance = no_primitive;
+};
+
+// Sum of a pixel's samples together with the running mean and variance of their luminance (Welford's
+// algorithm), which adaptive sampling uses to decide when the pixel has converged, and the sum of the
+// samples' surface features, except for the ids, which come from the first sample. The sum of squared
+// albedo luminances tells the denoiser whether the samples saw one surface color, which they do not
+// inside participating media or along edges.
+struct pixel_estimate
+{
+    color sum{0, 0, 0};
+    std::uint32_t samples = 0;
+    float mean = 0.f;
+    float m2 = 0.f;
+    surface_features features{};
+    float albedo_squares = 0.f;
+
+    auto add(const color &c, const surface_features &f) -> void
+    {
+        if (samples == 0)
+        {
+            features.mat = f.mat;
+            features.prim = f.prim;
+            features.instance = f.instance;
+        }
+        sum += c;
+        features.albedo += f.albedo;
+        features.normal += f.normal;
+        features.depth += f.depth;
+        features.motion.x += f.motion.x;
+        features.motion.y += f.motion.y;
+        const auto a = luminance(f.albedo);
+        albedo_squares += a * a;
+        ++samples;
+        const auto l = luminance(c);
+        const auto delta = l - mean;
+        mean += delta / samples;
+        m2 += delta * (l - mean);
+    }
+
+    // Standard error of the mean luminance relative to the mean. Near-black pixels are measured against
+    // a small floor so they can converge too.
+    auto relative_error() const -> float
+    {
+        if (samples < 2)
+            return infinity;
+        const auto variance = m2 / (samples - 1);
+        return std::sqrtf(variance / samples) / std::max(mean, 1e-3f);
+    }
+
+    auto value() const -> color { return samples > 0 ? (1.f / samples) * sum : color{0, 0, 0}; }
+
+    auto feature_value() const -> surface_features
+    {
+        if (samples == 0)
+            return surface_features{};
+        const auto scale = 1.f / samples;
+        return surface_features{scale * features.albedo, scale * features.normal, scale * features.depth, vec2{scale * features.motion.x, scale * features.motion.y}, features.mat, features.prim, features.instance};
+    }
+
+    // Variance of the albedo luminance across the samples.
+    auto albedo_variance() const -> float
+    {
+        if (samples == 0)
+            return 0.f;
+        const auto a = luminance(features.albedo) / samples;
+        return std::max(albedo_squares / samples - a * a, 0.f);
+    }
+};
+
+// Arbitrary output variables the camera can write next to the image.
+enum class aov
+{
+    depth,
+    normal,
+    albedo,
+    material_id,
+    primitive_id,
+    instance_id,
+    motion,
+    sample_count,
+};
+
+inline constexpr aov all_aovs[] = {aov::depth, aov::normal, aov::albedo, aov::material_id, aov::primitive_id, aov::instance_id, aov::motion, aov::sample_count};
+
+inline auto aov_name(aov a) -> std::string_view
+{
+    switch (a)
+    {
+    case aov::depth:
+        return "depth";
+    case aov::normal:
+        return "normal";
+    case aov::albedo:
+        return "albedo";
+    case aov::material_id:
+        return "material_id";
+    case aov::primitive_id:
+        return "primitive_id";
+    case aov::instance_id:
+        return "instance_id";
+    case aov::motion:
+        return "motion";
+    case aov::sample_count:
+        return "sample_count";
+    }
+    return "";
+}
+
+// Id aovs hold integers, which must not be rounded to half floats.
+inline auto aov_is_id(aov a) -> bool
+{
+    return a == aov::material_id || a == aov::primitive_id || a == aov::instance_id;
+}
+
+// Float channels only hold integers up to 2^24 exactly, so ids are split into their high and low 16
+// bits in red and green, with blue set to 1. Missing ids are -1 in all three channels.
+inline auto id_color(std::uint32_t id, bool missing) -> color
+{
+    if (missing)
+        return color{-1.f, -1.f, -1.f};
+    return color{static_cast<float>(id >> 16), static_cast<float>(id & 0xffffu), 1.f};
+}
+
+inline auto aov_from_name(std::string_view name) -> std::optional<aov>
+{
+    for (const auto a : all_aovs)
+    {
+        if (aov_name(a) == name)
+            return a;
+    }
+    return std::nullopt;
+}
+
+// Float accumulation buffer the camera renders into. Pixels can take any number of samples across
+// any number of passes, and the image is their per-pixel average.
+struct film
+{
+    film() = default;
+    film(std::size_t width, std::size_t height) : m_width{width}, m_height{height}, pixels(width * height) {}
+
+    auto at(std::size_t x, std::size_t y) -> pixel_estimate & { return pixels[y * m_width + x]; }
+    auto at(std::size_t x, std::size_t y) const -> const pixel_estimate & { return pixels[y * m_width + x]; }
+
+    auto to_hdr() const -> hdr_image
+    {
+        auto img = hdr_image{m_width, m_height};
+        for (std::size_t y = 0; y < m_height; ++y)
+        {
+            for (std::size_t x = 0; x < m_width; ++x)
+                img.set_color(x, y, at(x, y).value());
+        }
+        return img;
+    }
+
+    // One aov as an RGB float image. Scalars are repeated in all three channels, motion is (x, y, 0)
+    // and ids are encoded by id_color.
+    auto aov_image(aov a) const -> hdr_image
+    {
+        auto img = hdr_image{m_width, m_height};
+        for (std::size_t y = 0; y < m_height; ++y)
+        {
+            for (std::size_t x = 0; x < m_width; ++x)
+            {
+                const auto &estimate = at(x, y);
+                const auto f = estimate.feature_value();
+                auto c = color{0, 0, 0};
+                switch (a)
+                {
+                case aov::depth:
+                    c = color{f.depth, f.depth, f.depth};
+                    break;
+                case aov::normal:
+                    c = f.normal;
+                    break;
+                case aov::albedo:
+                    c = f.albedo;
+                    break;
+                case aov::material_id:
+                    c = id_color(f.mat, f.mat == no_material);
+                    break;
+                case aov::primitive_id:
+                    c = id_color(f.prim, f.prim == no_primitive);
+                    break;
+                case aov::instance_id:
+                    c = id_color(f.instance, f.instance == no_primitive);
+                    break;
+                case aov::motion:
+                    c = color{f.motion.x, f.motion.y, 0};
+                    break;
+                case aov::sample_count:
+                {
+                    const auto n = static_cast<float>(estimate.samples);
+                    c = color{n, n, n};
+                    break;
+                }
+                }
+                img.set_color(x, y, c);
+            }
+        }
+        return img;
+    }
+
+    auto width() const -> std::size_t { return m_width; }
+    auto height() const -> std::size_t { return m_height; }
+    auto pixel_count() const -> std::size_t { return pixels.size(); }
+    auto data() -> pixel_estimate * { return pixels.data(); }
+    auto data() const -> const pixel_estimate * { return pixels.data(); }
+
+private:
+    std::size_t m_width = 0;
+    std::size_t m_height = 0;
+    std::vector<pixel_estimate> pixels;
+};
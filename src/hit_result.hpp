@@ -1,17 +1,79 @@
 #pragma once
 
-#include <memory>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <print>
 
 #include "common.hpp"
 
+// Index into the material table of the scene's top-level world.
+using material_id = std::uint32_t;
+inline constexpr material_id no_material = ~material_id{0};
 
-struct material;
+using primitive_id = std::uint32_t;
+inline constexpr primitive_id no_primitive = ~primitive_id{0};
+
+// Primitives take ids in construction order, so every process that builds the same scene agrees on
+// them. Returns the first of `count` consecutive ids.
+inline auto next_primitive_id(primitive_id count = 1) -> primitive_id
+{
+    static std::atomic<primitive_id> next{0};
+    return next.fetch_add(count, std::memory_order_relaxed);
+}
+
+struct raytraceable;
+struct sampler;
+
+// What closest-hit traversal keeps of the nearest candidate so far: just enough for
+// raytraceable::compute_interaction to fill in the surface attributes afterwards, once. path holds
+// the primitive that was hit followed by the transforms above it, innermost first.
+struct intersection
+{
+    static constexpr std::size_t max_depth = 8;
+
+    float t{};
+    float u{}; // primitive specific surface coordinates, e.g. barycentrics
+    float v{};
+    std::uint32_t index{}; // which primitive of a mesh or pool was hit
+    const raytraceable *path[max_depth]{};
+    std::uint8_t depth = 0;
+    sampler *medium_sampler = nullptr; // draws the scattering distance in participating media
+
+    // Records a hit on a primitive, replacing any earlier candidate.
+    auto set(const raytraceable *primitive, float hit_t, float hit_u = 0.f, float hit_v = 0.f, std::uint32_t hit_index = 0) -> void
+    {
+        t = hit_t;
+        u = hit_u;
+        v = hit_v;
+        index = hit_index;
+        path[0] = primitive;
+        depth = 1;
+    }
+
+    // Adds a transform above the recorded primitive. Deeper chains than max_depth are not supported
+    // and abort the render, since dropping a level would return hits in the wrong space; instance::of
+    // folds chains of transforms into one.
+    auto push(const raytraceable *transform) -> void
+    {
+        if (depth >= max_depth) [[unlikely]]
+        {
+            std::println("objects are nested in more than {} transforms", max_depth - 1);
+            std::abort();
+        }
+        path[depth++] = transform;
+    }
+};
 
 struct hit_result
 {
     vec3 p{};
     vec3 normal{};
-    std::shared_ptr<material> mat;
+    vec3 velocity{}; // how far the surface point moves from shutter open to close
+    material_id mat = no_material;
+    primitive_id prim = no_primitive;
+    primitive_id instance = no_primitive; // the outermost instance the primitive was hit through, if any
     float t{};
     float u{};
     float v{};
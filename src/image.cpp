@@ -1,9 +1,229 @@
 #include "image.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "simd.hpp"
 #include "stb_image_write.h"
 
-auto image::write(std::filesystem::path path) const -> void
+auto image::write(std::filesystem::path path) const -> bool
 {
     auto stride_bytes = m_width * channels;
-    stbi_write_png(path.string().c_str(), m_width, m_height, channels, data.data(), stride_bytes);
-}
\ No newline at end of file
+    return stbi_write_png(path.string().c_str(), m_width, m_height, channels, data.data(), stride_bytes) != 0;
+}
+
+namespace
+{
+    constexpr auto max_gamma = 0.999f;
+
+    auto tonemap_scalar(float v, const tonemap_settings &settings) -> std::uint8_t
+    {
+        v *= settings.exposure;
+        if (settings.op == tonemap_operator::reinhard)
+            v = v / (1.f + v);
+        v = v > 0.f ? v : 0.f; // also maps NaN to black
+        return static_cast<std::uint8_t>(256.f * std::min(std::sqrtf(v), max_gamma));
+    }
+
+#if defined(RTW_X86_64)
+    // Same arithmetic as tonemap_scalar on four floats at a time.
+    auto tonemap_sse(const float *in, std::uint8_t *out, std::size_t count, const tonemap_settings &settings) -> std::size_t
+    {
+        const auto exposure = _mm_set1_ps(settings.exposure);
+        const auto zero = _mm_setzero_ps();
+        const auto one = _mm_set1_ps(1.f);
+        const auto max = _mm_set1_ps(max_gamma);
+        const auto scale = _mm_set1_ps(256.f);
+        const auto reinhard = settings.op == tonemap_operator::reinhard;
+
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            auto v = _mm_mul_ps(_mm_loadu_ps(in + i), exposure);
+            if (reinhard)
+                v = _mm_div_ps(v, _mm_add_ps(one, v));
+            v = _mm_max_ps(v, zero); // returns zero for NaN lanes
+            v = _mm_mul_ps(scale, _mm_min_ps(_mm_sqrt_ps(v), max));
+            const auto words = _mm_packs_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128());
+            const auto bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, _mm_setzero_si128()));
+            std::memcpy(out + i, &bytes, 4);
+        }
+        return i;
+    }
+#endif
+
+    // IEEE 754 binary16, round to nearest even.
+    auto float_to_half(float f) -> std::uint16_t
+    {
+        const auto bits = std::bit_cast<std::uint32_t>(f);
+        const auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+        const auto exponent = static_cast<int>((bits >> 23) & 0xffu);
+        auto mantissa = bits & 0x7fffffu;
+
+        if (exponent == 0xff)
+            return sign | 0x7c00u | (mantissa ? 0x200u : 0u);
+
+        const auto half_exponent = exponent - 127 + 15;
+        if (half_exponent >= 0x1f)
+            return sign | 0x7c00u;
+        if (half_exponent <= 0)
+        {
+            if (half_exponent < -10)
+                return sign;
+            mantissa |= 0x800000u;
+            const auto shift = static_cast<std::uint32_t>(14 - half_exponent);
+            auto half_mantissa = mantissa >> shift;
+            const auto rest = mantissa & ((1u << shift) - 1u);
+            const auto halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half_mantissa & 1u)))
+                ++half_mantissa;
+            return sign | static_cast<std::uint16_t>(half_mantissa);
+        }
+
+        auto half = static_cast<std::uint32_t>(half_exponent << 10) | (mantissa >> 13);
+        const auto rest = mantissa & 0x1fffu;
+        if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+            ++half; // may carry into the exponent, which rounds up to the next power of two or to infinity
+        return sign | static_cast<std::uint16_t>(half);
+    }
+
+    template <typename T>
+    auto put(std::ofstream &file, const T &value) -> void
+    {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    auto put_attribute(std::ofstream &file, const char *name, const char *type, std::int32_t size) -> void
+    {
+        file.write(name, std::strlen(name) + 1);
+        file.write(type, std::strlen(type) + 1);
+        put(file, size);
+    }
+}
+
+auto hdr_image::tonemap(const tonemap_settings &settings) const -> image
+{
+    auto img = image{m_width, m_height};
+    auto *out = img.bytes();
+    const auto count = data.size();
+
+    std::size_t i = 0;
+#if defined(RTW_X86_64)
+    i = tonemap_sse(data.data(), out, count, settings);
+#endif
+    for (; i < count; ++i)
+        out[i] = tonemap_scalar(data[i], settings);
+    return img;
+}
+
+auto hdr_image::write(std::filesystem::path path, const tonemap_settings &settings, bool half) const -> bool
+{
+    const auto extension = path.extension().string();
+    if (extension == ".pfm")
+        return write_pfm(path);
+    if (extension == ".hdr")
+        return write_radiance_hdr(path);
+    if (extension == ".exr")
+        return write_exr(path, half);
+    return tonemap(settings).write(path);
+}
+
+// The float writers assume a little endian host.
+
+// Portable float map: little endian (negative scale) RGB floats, rows from bottom to top.
+auto hdr_image::write_pfm(std::filesystem::path path) const -> bool
+{
+    auto file = std::ofstream{path, std::ios::binary | std::ios::trunc};
+    const auto header = "PF\n" + std::to_string(m_width) + " " + std::to_string(m_height) + "\n-1.0\n";
+    file.write(header.data(), header.size());
+    for (auto y = m_height; y-- > 0;)
+        file.write(reinterpret_cast<const char *>(&data[y * m_width * 3]), m_width * 3 * sizeof(float));
+    return static_cast<bool>(file);
+}
+
+auto hdr_image::write_radiance_hdr(std::filesystem::path path) const -> bool
+{
+    return stbi_write_hdr(path.string().c_str(), m_width, m_height, 3, data.data()) != 0;
+}
+
+// Single part scanline OpenEXR with no compression: header, one offset per scanline, then each
+// scanline as its y, byte count and the B, G and R channels (EXR orders channels by name).
+auto hdr_image::write_exr(std::filesystem::path path, bool half) const -> bool
+{
+    auto file = std::ofstream{path, std::ios::binary | std::ios::trunc};
+    const auto pixel_type = std::int32_t{half ? 1 : 2};
+    const auto channel_bytes = half ? sizeof(std::uint16_t) : sizeof(float);
+    const auto max_x = static_cast<std::int32_t>(m_width) - 1;
+    const auto max_y = static_cast<std::int32_t>(m_height) - 1;
+
+    put(file, std::uint32_t{20000630}); // magic
+    put(file, std::uint32_t{2});        // version 2, single part scanline
+
+    const char *channel_names[] = {"B", "G", "R"};
+    put_attribute(file, "channels", "chlist", 3 * 18 + 1);
+    for (const auto *name : channel_names)
+    {
+        file.write(name, 2);
+        put(file, pixel_type);
+        put(file, std::uint32_t{0}); // pLinear and reserved
+        put(file, std::int32_t{1});  // x sampling
+        put(file, std::int32_t{1});  // y sampling
+    }
+    put(file, std::uint8_t{0});
+
+    put_attribute(file, "compression", "compression", 1);
+    put(file, std::uint8_t{0});
+    for (const auto *window : {"dataWindow", "displayWindow"})
+    {
+        put_attribute(file, window, "box2i", 16);
+        put(file, std::int32_t{0});
+        put(file, std::int32_t{0});
+        put(file, max_x);
+        put(file, max_y);
+    }
+    put_attribute(file, "lineOrder", "lineOrder", 1);
+    put(file, std::uint8_t{0});
+    put_attribute(file, "pixelAspectRatio", "float", 4);
+    put(file, 1.f);
+    put_attribute(file, "screenWindowCenter", "v2f", 8);
+    put(file, 0.f);
+    put(file, 0.f);
+    put_attribute(file, "screenWindowWidth", "float", 4);
+    put(file, 1.f);
+    put(file, std::uint8_t{0});
+
+    const auto line_bytes = static_cast<std::int32_t>(m_width * 3 * channel_bytes);
+    const auto first_line = static_cast<std::uint64_t>(file.tellp()) + m_height * sizeof(std::uint64_t);
+    for (std::size_t y = 0; y < m_height; ++y)
+        put(file, first_line + y * (2 * sizeof(std::int32_t) + line_bytes));
+
+    auto line = std::vector<char>(line_bytes);
+    for (std::size_t y = 0; y < m_height; ++y)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            const auto source = 2 - c; // B, G, R from RGB
+            for (std::size_t x = 0; x < m_width; ++x)
+            {
+                const auto value = data[(y * m_width + x) * 3 + source];
+                auto *dst = line.data() + (c * m_width + x) * channel_bytes;
+                if (half)
+                {
+                    const auto h = float_to_half(value);
+                    std::memcpy(dst, &h, sizeof(h));
+                }
+                else
+                {
+                    std::memcpy(dst, &value, sizeof(value));
+                }
+            }
+        }
+        put(file, static_cast<std::int32_t>(y));
+        put(file, line_bytes);
+        file.write(line.data(), line.size());
+    }
+    return static_cast<bool>(file);
+}
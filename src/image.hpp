@@ -41,14 +41,75 @@ public:
         data[(y * m_width + x) * channels + 2] = bbyte;
     }
 
-    auto write(std::filesystem::path path) const -> void;
+    // Writes a PNG and returns whether it succeeded.
+    auto write(std::filesystem::path path) const -> bool;
 
     auto width() const -> std::size_t { return m_width; }
     auto height() const -> std::size_t { return m_height; }
-    
+    auto bytes() -> std::uint8_t * { return data.data(); }
+
 private:
     std::size_t m_width = 1;
     std::size_t m_height = 1;
     std::size_t channels = 3;
     std::vector<std::uint8_t> data;
 };
+
+enum class tonemap_operator
+{
+    clamp,    // values above 1 saturate
+    reinhard, // x / (1 + x), compresses highlights instead of clipping them
+};
+
+struct tonemap_settings
+{
+    tonemap_operator op = tonemap_operator::clamp;
+    float exposure = 1.f;
+};
+
+// Linear float RGB framebuffer. Nothing is clamped or gamma encoded, so it can be written to the
+// float formats, merged with other renders or denoised. Display images come from `tonemap`.
+class hdr_image
+{
+public:
+    hdr_image() {}
+    hdr_image(std::size_t width, std::size_t height)
+        : m_width{width}, m_height{height}, data(width * height * 3, 0.f)
+    {
+    }
+
+    auto set_color(std::size_t x, std::size_t y, const color &c) -> void
+    {
+        auto *p = &data[(y * m_width + x) * 3];
+        p[0] = c.x;
+        p[1] = c.y;
+        p[2] = c.z;
+    }
+
+    auto get_color(std::size_t x, std::size_t y) const -> color
+    {
+        const auto *p = &data[(y * m_width + x) * 3];
+        return color{p[0], p[1], p[2]};
+    }
+
+    // Exposure, tone curve, gamma 2 and quantization to 8 bits in one pass over the whole buffer.
+    auto tonemap(const tonemap_settings &settings = {}) const -> image;
+
+    // Picks the format from the extension: .pfm, .hdr (Radiance RGBE) and .exr (uncompressed,
+    // 16 bit half floats when `half` is set) keep the linear values, anything else is tone mapped to PNG.
+    auto write(std::filesystem::path path, const tonemap_settings &settings = {}, bool half = false) const -> bool;
+
+    auto write_pfm(std::filesystem::path path) const -> bool;
+    auto write_radiance_hdr(std::filesystem::path path) const -> bool;
+    auto write_exr(std::filesystem::path path, bool half = false) const -> bool;
+
+    auto width() const -> std::size_t { return m_width; }
+    auto height() const -> std::size_t { return m_height; }
+    auto floats() -> float * { return data.data(); }
+    auto floats() const -> const float * { return data.data(); }
+
+private:
+    std::size_t m_width = 1;
+    std::size_t m_height = 1;
+    std::vector<float> data;
+};
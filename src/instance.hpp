@@ -0,0 +1,125 @@
+#pragma once
+
+#include <memory>
+
+#include "common.hpp"
+#include "raytraceable.hpp"
+#include "bvh.hpp"
+
+// A placement of a shared bottom-level object, usually a bvh built by build_bvh, under an affine
+// transform. Instances go into the world like any other object, so the world's bvh is the top level
+// over them. Rays are moved into object space once per instance; t is unchanged because the direction
+// is transformed without normalizing it.
+struct instance : raytraceable
+{
+    std::shared_ptr<const raytraceable> object;
+    affine to_world{};
+    affine to_object{};
+    // replaces the materials of the object's primitives when set, so one blas can be shared across materials
+    material_id mat = no_material;
+    // reported as hit_result::instance; the primitives inside keep their own ids
+    primitive_id id;
+
+    instance(std::shared_ptr<const raytraceable> object, const affine &to_world, material_id mat = no_material)
+        : object(object), to_world(to_world), to_object(to_world.inverse()), mat(mat), id(next_primitive_id())
+    {
+        m_bbox = to_world.bounds(object->bbox());
+    }
+
+    // Moves the instance. The bvh holding it has to be refit afterwards.
+    auto set_transform(const affine &transform) -> void
+    {
+        to_world = transform;
+        to_object = transform.inverse();
+        m_bbox = to_world.bounds(object->bbox());
+    }
+
+    // Places object under to_world. Instances, translate and rotate_y wrapping the object are folded
+    // into the one matrix, so a chain of transforms costs a single ray transform.
+    static auto of(std::shared_ptr<const raytraceable> object, const affine &to_world, material_id mat = no_material) -> std::shared_ptr<instance>
+    {
+        if (const auto *inner = dynamic_cast<const instance *>(object.get()))
+            return of(inner->object, to_world * inner->to_world, mat != no_material ? mat : inner->mat);
+        if (const auto *inner = dynamic_cast<const translate *>(object.get()))
+            return of(inner->object, to_world * affine::translation(inner->offset), mat);
+        if (const auto *inner = dynamic_cast<const rotate_y *>(object.get()))
+            return of(inner->object, to_world * affine::rotation_y(angle::from_radians(std::atan2f(inner->sin_theta, inner->cos_theta))), mat);
+        return std::make_shared<instance>(object, to_world, mat);
+    }
+
+    auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool override
+    {
+        auto inner = intersection{};
+        inner.medium_sampler = isect.medium_sampler;
+        if (!object->intersect(to_object_space(r), t, inner))
+            return false;
+
+        isect = inner;
+        isect.push(this);
+        return true;
+    }
+
+    auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void override
+    {
+        isect.path[level - 1]->compute_interaction(to_object_space(r), isect, level - 1, res);
+
+        res.p = to_world.point(res.p);
+        res.normal = to_object.transposed_vector(res.normal).normalized();
+        res.velocity = to_world.vector(res.velocity);
+        if (mat != no_material)
+            res.mat = mat;
+        // compute_interaction runs innermost first, so the outermost instance is the one reported
+        res.instance = id;
+    }
+
+    auto occluded(const ray &r, const interval &t) const -> bool override
+    {
+        return object->occluded(to_object_space(r), t);
+    }
+
+    auto bbox() const -> aabb override { return m_bbox; }
+
+    // exact for rigid transforms, which keep solid angles
+    auto pdf_value(const vec3 &origin, const vec3 &direction) const -> float override
+    {
+        return object->pdf_value(to_object.point(origin), to_object.vector(direction));
+    }
+
+    auto random(const vec3 &origin, sampler &s) const -> vec3 override
+    {
+        return to_world.vector(object->random(to_object.point(origin), s));
+    }
+
+private:
+    aabb m_bbox;
+
+    auto to_object_space(const ray &r) const -> ray
+    {
+        return ray{to_object.point(r.origin), to_object.vector(r.direction), r.time};
+    }
+};
+
+// The six quads of the unit cube in a bvh, built once and shared by every box.
+inline auto unit_box() -> std::shared_ptr<const raytraceable>
+{
+    static const auto blas = []
+    {
+        auto sides = world{};
+        sides.add(std::make_shared<quad>(vec3{0, 0, 1}, vec3{1, 0, 0}, vec3{0, 1, 0}, no_material));
+        sides.add(std::make_shared<quad>(vec3{1, 0, 1}, vec3{0, 0, -1}, vec3{0, 1, 0}, no_material));
+        sides.add(std::make_shared<quad>(vec3{1, 0, 0}, vec3{-1, 0, 0}, vec3{0, 1, 0}, no_material));
+        sides.add(std::make_shared<quad>(vec3{0, 0, 0}, vec3{0, 0, 1}, vec3{0, 1, 0}, no_material));
+        sides.add(std::make_shared<quad>(vec3{0, 1, 1}, vec3{1, 0, 0}, vec3{0, 0, -1}, no_material));
+        sides.add(std::make_shared<quad>(vec3{0, 0, 0}, vec3{1, 0, 0}, vec3{0, 0, 1}, no_material));
+        return std::shared_ptr<const raytraceable>{build_bvh(sides)};
+    }();
+    return blas;
+}
+
+// The box spanned by corners a and b, as an instance of unit_box.
+inline auto box(const vec3 &a, const vec3 &b, material_id mat) -> std::shared_ptr<instance>
+{
+    auto min = vec3{std::fminf(a.x, b.x), std::fminf(a.y, b.y), std::fminf(a.z, b.z)};
+    auto max = vec3{std::fmaxf(a.x, b.x), std::fmaxf(a.y, b.y), std::fmaxf(a.z, b.z)};
+    return std::make_shared<instance>(unit_box(), affine::translation(min) * affine::scaling(max - min), mat);
+}
@@ -1,25 +1,170 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <string_view>
 #include <filesystem>
+#include <optional>
+#include <print>
+#include <string>
+#include <vector>
 
 #include "common.hpp"
 #include "raytraceable.hpp"
+#include "bvh.hpp"
+#include "instance.hpp"
+#include "mesh.hpp"
+#include "mesh_import.hpp"
+#include "sphere_pool.hpp"
 #include "material.hpp"
 #include "camera.hpp"
+#include "distributed.hpp"
+#include "animation.hpp"
 
+// usage: <output path> [threads] [--checkpoint <path>] [--resume] [--denoise] [--aov <name>|all]...
+//        [--frames <count>] [--mesh <obj or ply path>] [--scene cornell|complex]
+//        <output path> --coordinator <port>
+//        [threads] --worker <host:port>
 struct args
 {
     std::string_view path;
     std::filesystem::path output_path;
     std::size_t threads = 1;
+    std::filesystem::path checkpoint_path;
+    bool resume = false;
+    bool denoise = false;
+    std::vector<aov> aovs;
+    std::size_t frames = 0; // non-zero renders the animated scene to numbered files
+    std::filesystem::path mesh_path; // renders this mesh in the cornell box instead of the two boxes
+    std::string_view scene = "cornell";
+    std::optional<std::uint16_t> coordinator_port;
+    std::string worker_host;
+    std::uint16_t worker_port = 0;
+    bool valid = true; // false after a malformed argument, which has been reported
+
+    // Identifies the scene these arguments build, so a coordinator can turn away workers building
+    // another one.
+    auto scene_hash() const -> std::uint64_t
+    {
+        auto h = hash_combine(0, frames);
+        const auto mesh = mesh_path.string();
+        for (const auto text : {scene, std::string_view{mesh}})
+        {
+            h = hash_combine(h, text.size());
+            for (const auto c : text)
+                h = hash_combine(h, static_cast<unsigned char>(c));
+        }
+        return h;
+    }
+
+    // A TCP port number, or nothing when text is not one.
+    static auto parse_port(std::string_view text) -> std::optional<std::uint16_t>
+    {
+        auto port = std::uint32_t{0};
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), port);
+        if (error != std::errc{} || end != text.data() + text.size() || port == 0 || port > 65535)
+            return std::nullopt;
+        return static_cast<std::uint16_t>(port);
+    }
+
+    // A non-negative count, or nothing when text is not one.
+    static auto parse_count(std::string_view text) -> std::optional<std::size_t>
+    {
+        auto count = std::size_t{0};
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+        if (error != std::errc{} || end != text.data() + text.size())
+            return std::nullopt;
+        return count;
+    }
 
     static auto from(int argc, char *argv[]) -> args
     {
         args args{};
         args.path = argv[0];
-        args.output_path = argv[1];
-        if (argc > 2)
+        auto positional = std::vector<std::string_view>{};
+        for (int i = 1; i < argc; ++i)
+        {
+            const auto arg = std::string_view{argv[i]};
+            if (arg == "--resume")
+                args.resume = true;
+            else if (arg == "--denoise")
+                args.denoise = true;
+            else if (arg == "--frames" && i + 1 < argc)
+            {
+                const auto count = std::string_view{argv[++i]};
+                const auto frames = parse_count(count);
+                if (!frames)
+                {
+                    std::println("invalid frame count {}, expected --frames <count>", count);
+                    args.valid = false;
+                    continue;
+                }
+                args.frames = *frames;
+            }
+            else if (arg == "--mesh" && i + 1 < argc)
+                args.mesh_path = argv[++i];
+            else if (arg == "--scene" && i + 1 < argc)
+                args.scene = argv[++i];
+            else if (arg == "--aov" && i + 1 < argc)
+            {
+                const auto name = std::string_view{argv[++i]};
+                if (name == "all")
+                    args.aovs.assign(std::begin(all_aovs), std::end(all_aovs));
+                else if (const auto a = aov_from_name(name))
+                    args.aovs.push_back(*a);
+                else
+                    std::println("unknown aov {}", name);
+            }
+            else if (arg == "--checkpoint" && i + 1 < argc)
+                args.checkpoint_path = argv[++i];
+            else if (arg == "--coordinator" && i + 1 < argc)
+            {
+                const auto port = std::string_view{argv[++i]};
+                args.coordinator_port = parse_port(port);
+                if (!args.coordinator_port)
+                {
+                    std::println("invalid port {}, expected --coordinator <port> with a port from 1 to 65535", port);
+                    args.valid = false;
+                }
+            }
+            else if (arg == "--worker" && i + 1 < argc)
+            {
+                const auto address = std::string_view{argv[++i]};
+                const auto colon = address.rfind(':');
+                const auto port = colon == std::string_view::npos ? std::nullopt : parse_port(address.substr(colon + 1));
+                if (colon == 0 || !port)
+                {
+                    std::println("invalid address {}, expected --worker <host:port> with a port from 1 to 65535", address);
+                    args.valid = false;
+                    continue;
+                }
+                args.worker_host = address.substr(0, colon);
+                args.worker_port = *port;
+            }
+            else
+                positional.push_back(arg);
+        }
+
+        // workers write no image, so their only positional argument is the thread count
+        auto next = std::begin(positional);
+        if (args.worker_host.empty() && next != std::end(positional))
+            args.output_path = *next++;
+        if (next != std::end(positional))
+        {
+            const auto threads = parse_count(*next);
+            if (threads)
+                args.threads = *threads;
+            else
+            {
+                std::println("invalid thread count {}", *next);
+                args.valid = false;
+            }
+        }
+
+        // resuming without an explicit checkpoint looks next to the output
+        if (args.resume && args.checkpoint_path.empty())
         {
-            args.threads = std::stoul(argv[2]);
+            args.checkpoint_path = args.output_path;
+            args.checkpoint_path += ".ckpt";
         }
         return args;
     }
@@ -27,16 +172,13 @@ struct args
 
 auto scene_topdown(world &world, camera &cam) -> void
 {
-    auto material_white = std::make_shared<lambertian>(lambertian::from_color(color{0.73f, 0.73f, 0.73f}));
-    auto material_normals = std::make_shared<normals>();
-    auto material_ground = std::make_shared<lambertian>(lambertian::from_color(color{0.8f, 0.8f, 0.f}));
-    auto material_center = std::make_shared<lambertian>(lambertian::from_color(color{0.1f, 0.2f, 0.5f}));
-    auto material_left = std::make_shared<dielectric>(1.5f);
-    auto material_bubble = std::make_shared<dielectric>(1.f / 1.5f);
-    auto material_right = std::make_shared<metal>(color{0.8f, 0.6f, 0.2f}, 1.f);
+    auto material_center = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{0.1f, 0.2f, 0.5f})));
+    auto material_left = world.add_material(std::make_shared<dielectric>(1.5f));
+    auto material_bubble = world.add_material(std::make_shared<dielectric>(1.f / 1.5f));
+    auto material_right = world.add_material(std::make_shared<metal>(color{0.8f, 0.6f, 0.2f}, 1.f));
     auto checker_tex = checker_texture::from_colors(0.32f, color{0.2f, 0.3f, 0.1f}, color{0.9f, 0.9f, 0.9f});
-    auto material_checker = std::make_shared<lambertian>(
-        lambertian::from_texture(checker_tex));
+    auto material_checker = world.add_material(std::make_shared<lambertian>(
+        lambertian::from_texture(checker_tex)));
 
     world.add(std::make_shared<sphere>(sphere::stationary(vec3{0.f, -100.5f, -1.f}, 100.0f, material_checker)));
     world.add(std::make_shared<sphere>(sphere::stationary(vec3{0.f, 0.f, -1.2f}, 0.5f, material_center)));
@@ -56,11 +198,69 @@ auto scene_topdown(world &world, camera &cam) -> void
     cam.defocus_angle = angle::from_degrees(0.f);
 }
 
+// The final scene of the first book: a field of small random spheres around three large ones, all
+// in one sphere pool.
+auto scene_complex(world &world, camera &cam) -> void
+{
+    auto spheres = std::vector<sphere>{};
+
+    auto ground = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{0.5f, 0.5f, 0.5f})));
+    spheres.push_back(sphere::stationary(vec3{0.f, -1000.f, 0.f}, 1000.f, ground));
+
+    for (int a = -11; a < 11; a++)
+    {
+        for (int b = -11; b < 11; b++)
+        {
+            const auto choose_mat = randf();
+            const auto center = vec3{a + 0.9f * randf(), 0.2f, b + 0.9f * randf()};
+            if ((center - vec3{4.f, 0.2f, 0.f}).magnitude() <= 0.9f)
+                continue;
+
+            if (choose_mat < 0.8f)
+            {
+                auto albedo = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color::random() * color::random())));
+                spheres.push_back(sphere::moving(center, center + vec3{0.f, randf(0.f, 0.5f), 0.f}, 0.2f, albedo));
+            }
+            else if (choose_mat < 0.95f)
+            {
+                auto shiny = world.add_material(std::make_shared<metal>(color::random(0.5f, 1.f), randf(0.f, 0.5f)));
+                spheres.push_back(sphere::stationary(center, 0.2f, shiny));
+            }
+            else
+            {
+                auto glass = world.add_material(std::make_shared<dielectric>(1.5f));
+                spheres.push_back(sphere::stationary(center, 0.2f, glass));
+            }
+        }
+    }
+
+    auto glass = world.add_material(std::make_shared<dielectric>(1.5f));
+    spheres.push_back(sphere::stationary(vec3{0.f, 1.f, 0.f}, 1.f, glass));
+    auto brown = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{0.4f, 0.2f, 0.1f})));
+    spheres.push_back(sphere::stationary(vec3{-4.f, 1.f, 0.f}, 1.f, brown));
+    auto steel = world.add_material(std::make_shared<metal>(color{0.7f, 0.6f, 0.5f}, 0.f));
+    spheres.push_back(sphere::stationary(vec3{4.f, 1.f, 0.f}, 1.f, steel));
+
+    world.add(std::make_shared<sphere_pool>(sphere_pool::from_spheres(spheres)));
+
+    cam.aspect_ratio = 16.f / 9.f;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 100;
+    cam.max_depth = 50;
+    cam.background = color{0.70f, 0.80f, 1.00f};
+    cam.vfov = angle::from_degrees(20);
+    cam.look_from = vec3{13.f, 2.f, 3.f};
+    cam.look_at = vec3{0.f, 0.f, 0.f};
+    cam.up = vec3{0.f, 1.f, 0.f};
+    cam.defocus_angle = angle::from_degrees(0.6f);
+    cam.focus_dist = 10.f;
+}
+
 auto scene_earth(world &world, camera &cam) -> void
 {
     auto earth_text = image_texture::from_file("earthmap.jpg");
-    auto earth_material = std::make_shared<lambertian>(
-        lambertian::from_texture(earth_text));
+    auto earth_material = world.add_material(std::make_shared<lambertian>(
+        lambertian::from_texture(earth_text)));
 
     world.add(std::make_shared<sphere>(sphere::stationary(vec3{0.f, 0.f, 0.f}, 2.f, earth_material)));
 
@@ -79,8 +279,9 @@ auto scene_earth(world &world, camera &cam) -> void
 auto scene_perlin(world &world, camera &cam) -> void
 {
     auto noise_tex = std::make_shared<noise_texture>(4);
-    world.add(std::make_shared<sphere>(sphere::stationary(vec3{0, -1000, 0}, 1000, std::make_shared<lambertian>(lambertian::from_texture(noise_tex)))));
-    world.add(std::make_shared<sphere>(sphere::stationary(vec3{0, 2, 0}, 2, std::make_shared<lambertian>(lambertian::from_texture(noise_tex)))));
+    auto noise_material = world.add_material(std::make_shared<lambertian>(lambertian::from_texture(noise_tex)));
+    world.add(std::make_shared<sphere>(sphere::stationary(vec3{0, -1000, 0}, 1000, noise_material)));
+    world.add(std::make_shared<sphere>(sphere::stationary(vec3{0, 2, 0}, 2, noise_material)));
 
     cam.aspect_ratio = 16.0 / 9.0;
     cam.image_width = 400;
@@ -96,11 +297,11 @@ auto scene_perlin(world &world, camera &cam) -> void
 
 auto scene_quads(world &world, camera &cam) -> void
 {
-    auto left_red = std::make_shared<lambertian>(lambertian::from_color(color{1.0, 0.2, 0.2}));
-    auto back_green = std::make_shared<lambertian>(lambertian::from_color(color{0.2, 1.0, 0.2}));
-    auto right_blue = std::make_shared<lambertian>(lambertian::from_color(color{0.2, 0.2, 1.0}));
-    auto upper_orange = std::make_shared<lambertian>(lambertian::from_color(color{1.0, 0.5, 0.0}));
-    auto lower_teal = std::make_shared<lambertian>(lambertian::from_color(color{0.2, 0.8, 0.8}));
+    auto left_red = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{1.0, 0.2, 0.2})));
+    auto back_green = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{0.2, 1.0, 0.2})));
+    auto right_blue = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{0.2, 0.2, 1.0})));
+    auto upper_orange = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{1.0, 0.5, 0.0})));
+    auto lower_teal = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{0.2, 0.8, 0.8})));
 
     // Quads
     world.add(std::make_shared<quad>(vec3{-3, -2, 5}, vec3{0, 0, -4}, vec3{0, 4, 0}, left_red));
@@ -122,15 +323,23 @@ auto scene_quads(world &world, camera &cam) -> void
     cam.defocus_angle = angle::from_radians(0);
 }
 
-auto scene_cornell_box(world &w, world &lights, camera &cam) -> void
+// Materials of the cornell box walls, for the scenes that furnish it to reuse.
+struct cornell_materials
 {
-    auto red = std::make_shared<lambertian>(lambertian::from_color(color{.65, .05, .05}));
-    auto white = std::make_shared<lambertian>(lambertian::from_color(color{.73, .73, .73}));
-    auto green = std::make_shared<lambertian>(lambertian::from_color(color{.12, .45, .15}));
-    auto light = std::make_shared<diffuse_light>(color{15, 15, 15});
-    auto glass = std::make_shared<dielectric>(1.5f);
-    auto aluminum = std::make_shared<metal>(color{.8f, .85f, .88f}, 0.f);
-    auto empty = std::shared_ptr<material>();
+    material_id red;
+    material_id white;
+    material_id green;
+    material_id light;
+};
+
+// The walls, light and camera of the cornell box, without anything in it.
+auto scene_cornell_room(world &w, world &lights, camera &cam) -> cornell_materials
+{
+    auto red = w.add_material(std::make_shared<lambertian>(lambertian::from_color(color{.65, .05, .05})));
+    auto white = w.add_material(std::make_shared<lambertian>(lambertian::from_color(color{.73, .73, .73})));
+    auto green = w.add_material(std::make_shared<lambertian>(lambertian::from_color(color{.12, .45, .15})));
+    auto light = w.add_material(std::make_shared<diffuse_light>(color{15, 15, 15}));
+    auto empty = no_material;
 
     w.add(std::make_shared<quad>(vec3{555, 0, 0}, vec3{0, 555, 0}, vec3{0, 0, 555}, green));
     w.add(std::make_shared<quad>(vec3{0, 0, 0}, vec3{0, 555, 0}, vec3{0, 0, 555}, red));
@@ -139,16 +348,6 @@ auto scene_cornell_box(world &w, world &lights, camera &cam) -> void
     w.add(std::make_shared<quad>(vec3{555, 555, 555}, vec3{-555, 0, 0}, vec3{0, 0, -555}, white));
     w.add(std::make_shared<quad>(vec3{0, 0, 555}, vec3{555, 0, 0}, vec3{0, 555, 0}, white));
 
-    std::shared_ptr<raytraceable> box1 = box(vec3{0, 0, 0}, vec3{165, 330, 165}, aluminum);
-    box1 = std::make_shared<rotate_y>(box1, angle::from_degrees(15));
-    box1 = std::make_shared<translate>(box1, vec3{265, 0, 295});
-    w.add(box1);
-
-    std::shared_ptr<raytraceable> box2 = box(vec3{0, 0, 0}, vec3{165, 165, 165}, white);
-    box2 = std::make_shared<rotate_y>(box2, angle::from_degrees(-18));
-    box2 = std::make_shared<translate>(box2, vec3{130, 0, 65});
-    w.add(box2);
-
     lights.add(std::make_shared<quad>(vec3{343, 554, 332}, vec3{-130, 0, 0}, vec3{0, 0, -105}, empty));
 
     cam.aspect_ratio = 1.0;
@@ -161,14 +360,69 @@ auto scene_cornell_box(world &w, world &lights, camera &cam) -> void
     cam.look_at = vec3{278, 278, 0};
     cam.up = vec3{0, 1, 0};
     cam.defocus_angle = angle::from_radians(0);
+    return cornell_materials{red, white, green, light};
+}
+
+auto scene_cornell_box(world &w, world &lights, camera &cam) -> cornell_materials
+{
+    const auto room = scene_cornell_room(w, lights, cam);
+    auto aluminum = w.add_material(std::make_shared<metal>(color{.8f, .85f, .88f}, 0.f));
+
+    auto box1 = instance::of(box(vec3{0, 0, 0}, vec3{165, 330, 165}, aluminum), affine::translation(vec3{265, 0, 295}) * affine::rotation_y(angle::from_degrees(15)));
+    w.add(box1);
+
+    auto box2 = instance::of(box(vec3{0, 0, 0}, vec3{165, 165, 165}, room.white), affine::translation(vec3{130, 0, 65}) * affine::rotation_y(angle::from_degrees(-18)));
+    w.add(box2);
+    return room;
+}
+
+// The cornell box holding a mesh loaded from path, scaled to 330 units and standing on the floor.
+auto scene_cornell_mesh(world &w, world &lights, camera &cam, const std::filesystem::path &path, std::size_t threads) -> bool
+{
+    const auto room = scene_cornell_room(w, lights, cam);
+
+    const auto start = std::chrono::steady_clock::now();
+    auto buffers = mesh_buffers{};
+    if (!load_mesh(path, buffers, threads))
+        return false;
+    const auto loaded = std::chrono::steady_clock::now();
+
+    auto options = bvh_build_options{};
+    options.threads = threads;
+    auto mesh = std::make_shared<triangle_mesh>(triangle_mesh::from_buffers(std::move(buffers), room.white, options));
+    const auto built = std::chrono::steady_clock::now();
+    std::println("loaded {} triangles in {:.2f}s, built their bvh in {:.2f}s", mesh->buffers.triangle_count(),
+                 std::chrono::duration<float>(loaded - start).count(), std::chrono::duration<float>(built - loaded).count());
+
+    const auto bounds = mesh->bbox();
+    const auto scale = 330.f / std::max(bounds.x.size(), std::max(bounds.y.size(), bounds.z.size()));
+    const auto center = bounds.centroid();
+    w.add(instance::of(mesh, affine::translation(vec3{278 - scale * center.x, -scale * bounds.y.min, 278 - scale * center.z}) * affine::scaling(vec3{scale, scale, scale})));
+    return true;
+}
+
+// The cornell box with the camera dollying in while a small box slides across the floor, spinning.
+auto scene_cornell_box_animated(world &w, world &lights, camera &cam, animation &anim) -> void
+{
+    const auto room = scene_cornell_box(w, lights, cam);
+
+    auto slide = track<vec3>{{{0.f, vec3{120, 0, 140}}, {2.f, vec3{430, 0, 140}}}};
+    auto spin = track<float>{{{0.f, 0.f}, {2.f, 360.f}}};
+    auto spinner = std::make_shared<animated>(box(vec3{-40, 0, -40}, vec3{40, 80, 40}, room.white), slide, spin);
+    w.add(spinner);
+    anim.objects.push_back(spinner);
+
+    anim.camera_keys.look_from = track<vec3>{{{0.f, vec3{278, 278, -800}}, {2.f, vec3{278, 278, -600}}}};
+    anim.frame_count = 48;
+    anim.frames_per_second = 24.f;
 }
 
 auto scene_cornell_with_smoke(world &world, camera &cam) -> void
 {
-    auto red = std::make_shared<lambertian>(lambertian::from_color(color{.65, .05, .05}));
-    auto white = std::make_shared<lambertian>(lambertian::from_color(color{.73, .73, .73}));
-    auto green = std::make_shared<lambertian>(lambertian::from_color(color{.12, .45, .15}));
-    auto light = std::make_shared<diffuse_light>(color{7, 7, 7});
+    auto red = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{.65, .05, .05})));
+    auto white = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{.73, .73, .73})));
+    auto green = world.add_material(std::make_shared<lambertian>(lambertian::from_color(color{.12, .45, .15})));
+    auto light = world.add_material(std::make_shared<diffuse_light>(color{7, 7, 7}));
 
     world.add(std::make_shared<quad>(vec3{555, 0, 0}, vec3{0, 555, 0}, vec3{0, 0, 555}, green));
     world.add(std::make_shared<quad>(vec3{0, 0, 0}, vec3{0, 555, 0}, vec3{0, 0, 555}, red));
@@ -177,16 +431,14 @@ auto scene_cornell_with_smoke(world &world, camera &cam) -> void
     world.add(std::make_shared<quad>(vec3{0, 0, 0}, vec3{555, 0, 0}, vec3{0, 0, 555}, white));
     world.add(std::make_shared<quad>(vec3{0, 0, 555}, vec3{555, 0, 0}, vec3{0, 555, 0}, white));
 
-    std::shared_ptr<raytraceable> box1 = box(vec3{0, 0, 0}, vec3{165, 330, 165}, white);
-    box1 = std::make_shared<rotate_y>(box1, angle::from_degrees(15));
-    box1 = std::make_shared<translate>(box1, vec3{265, 0, 295});
+    auto box1 = instance::of(box(vec3{0, 0, 0}, vec3{165, 330, 165}, white), affine::translation(vec3{265, 0, 295}) * affine::rotation_y(angle::from_degrees(15)));
 
-    std::shared_ptr<raytraceable> box2 = box(vec3{0, 0, 0}, vec3{165, 165, 165}, white);
-    box2 = std::make_shared<rotate_y>(box2, angle::from_degrees(-18));
-    box2 = std::make_shared<translate>(box2, vec3{130, 0, 65});
+    auto box2 = instance::of(box(vec3{0, 0, 0}, vec3{165, 165, 165}, white), affine::translation(vec3{130, 0, 65}) * affine::rotation_y(angle::from_degrees(-18)));
 
-    world.add(std::make_shared<constant_medium>(box1, 0.01, color{0, 0, 0}));
-    world.add(std::make_shared<constant_medium>(box2, 0.01, color{1, 1, 1}));
+    auto black_smoke = world.add_material(std::make_shared<isotropic>(color{0, 0, 0}));
+    auto white_smoke = world.add_material(std::make_shared<isotropic>(color{1, 1, 1}));
+    world.add(std::make_shared<constant_medium>(box1, 0.01, black_smoke));
+    world.add(std::make_shared<constant_medium>(box2, 0.01, white_smoke));
 
     cam.aspect_ratio = 1.0;
     cam.image_width = 600;
@@ -205,10 +457,57 @@ auto scene_cornell_with_smoke(world &world, camera &cam) -> void
 auto main(int argc, char *argv[]) -> int
 {
     auto args = args::from(argc, argv);
+    if (!args.valid)
+        return 1;
     world w{};
     world lights{};
     camera cam{};
-    scene_cornell_box(w, lights, cam);
-    w.optimize();
-    cam.render(w, lights, args.output_path, args.threads);
+    animation anim{};
+    if (args.frames > 0)
+    {
+        scene_cornell_box_animated(w, lights, cam, anim);
+        anim.frame_count = args.frames;
+    }
+    else if (!args.mesh_path.empty())
+    {
+        if (!scene_cornell_mesh(w, lights, cam, args.mesh_path, args.threads))
+            return 1;
+    }
+    else if (args.scene == "complex")
+    {
+        scene_complex(w, cam);
+    }
+    else if (args.scene != "cornell")
+    {
+        std::println("unknown scene {}", args.scene);
+        return 1;
+    }
+    else
+    {
+        scene_cornell_box(w, lights, cam);
+    }
+
+    auto bvh_options = bvh_build_options{};
+    bvh_options.threads = args.threads;
+    w.optimize(bvh_options);
+
+    install_interrupt_handler();
+    cam.denoise = args.denoise;
+    cam.aovs = args.aovs;
+    if (args.coordinator_port)
+    {
+        auto options = coordinator_options{};
+        options.port = *args.coordinator_port;
+        options.scene_hash = args.scene_hash();
+        return run_coordinator(cam, options, args.output_path) ? 0 : 1;
+    }
+    if (!args.worker_host.empty())
+        return run_worker(cam, w, lights, args.worker_host, args.worker_port, args.threads, args.scene_hash()) ? 0 : 1;
+
+    cam.checkpoint_path = args.checkpoint_path;
+    cam.resume = args.resume;
+    if (args.frames > 0)
+        render_animation(cam, w, lights, anim, args.output_path, bvh_options, args.threads);
+    else
+        cam.render(w, lights, args.output_path, args.threads);
 }
@@ -8,7 +8,7 @@ struct material
 {
     virtual ~material() = default;
 
-    virtual auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres) const -> bool
+    virtual auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres, sampler &s) const -> bool
     {
         return false;
     }
@@ -22,17 +22,28 @@ struct material
     {
         return color{0, 0, 0};
     }
+
+    // Surface color without lighting, which the denoiser divides out so texture detail is not blurred.
+    virtual auto surface_albedo(const hit_result &res) const -> color
+    {
+        return color{1, 1, 1};
+    }
 };
 
 struct normals : material
 {
-    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres) const -> bool override
+    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres, sampler &s) const -> bool override
     {
         sres.attenuation = 0.5f * (res.normal + color{1, 1, 1});
-        sres.pdf_ptr = std::make_shared<cosine_pdf>(res.normal);
+        sres.sampling_pdf = cosine_pdf{res.normal};
         sres.skip_pdf = false;
         return true;
     }
+
+    auto surface_albedo(const hit_result &res) const -> color override
+    {
+        return 0.5f * (res.normal + color{1, 1, 1});
+    }
 };
 
 struct lambertian : material
@@ -55,10 +66,10 @@ struct lambertian : material
         return l;
     }
 
-    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres) const -> bool override
+    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres, sampler &s) const -> bool override
     {
         sres.attenuation = albedo->value(res.u, res.v, res.p);
-        sres.pdf_ptr = std::make_shared<cosine_pdf>(res.normal);
+        sres.sampling_pdf = cosine_pdf{res.normal};
         sres.skip_pdf = false;
         return true;
     }
@@ -68,6 +79,11 @@ struct lambertian : material
         const auto cos_theta = res.normal.dot(scattered.direction.normalized());
         return cos_theta < 0.f ? 0.f : cos_theta / pi;
     }
+
+    auto surface_albedo(const hit_result &res) const -> color override
+    {
+        return albedo->value(res.u, res.v, res.p);
+    }
 };
 
 struct metal : material
@@ -78,15 +94,19 @@ struct metal : material
     metal() = default;
     metal(color a, float fuzz) : albedo{a}, fuzz{std::min(fuzz, 1.f)} {}
 
-    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres) const -> bool override
+    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres, sampler &s) const -> bool override
     {
-        const auto reflected = r_in.direction.reflect(res.normal).normalized() + (fuzz * vec3::random_unit_vector());
+        const auto reflected = r_in.direction.reflect(res.normal).normalized() + (fuzz * vec3::unit_vector(s.get_2d()));
         sres.attenuation = albedo;
-        sres.pdf_ptr = nullptr;
         sres.skip_pdf = true;
         sres.skip_pdf_ray = ray{res.p, reflected, r_in.time};
         return true;
     }
+
+    auto surface_albedo(const hit_result &res) const -> color override
+    {
+        return albedo;
+    }
 };
 
 struct dielectric : material
@@ -96,10 +116,9 @@ struct dielectric : material
     dielectric() = default;
     dielectric(float refraction_index) : refraction_index{refraction_index} {}
 
-    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres) const -> bool override
+    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres, sampler &s) const -> bool override
     {
         sres.attenuation = color{1.f, 1.f, 1.f};
-        sres.pdf_ptr = nullptr;
         sres.skip_pdf = true;
         const auto ri = res.front_face ? (1.f / refraction_index) : refraction_index;
 
@@ -110,7 +129,7 @@ struct dielectric : material
         bool cannot_refract = ri * sin_theta > 1.f;
         vec3 dir{};
 
-        if (cannot_refract || reflectance(cos_theta, ri) > randf())
+        if (cannot_refract || reflectance(cos_theta, ri) > s.get_1d())
         {
             dir = dir_norm.reflect(res.normal);
         }
@@ -157,10 +176,10 @@ struct isotropic : material
     isotropic(const color &albedo) : tex(std::make_shared<solid_color>(solid_color::from_color(albedo))) {}
     isotropic(std::shared_ptr<texture> tex) : tex(tex) {}
 
-    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres) const -> bool override
+    auto scatter(const ray &r_in, const hit_result &res, scatter_result& sres, sampler &s) const -> bool override
     {
         sres.attenuation = tex->value(res.u, res.v, res.p);
-        sres.pdf_ptr = std::make_shared<sphere_pdf>();
+        sres.sampling_pdf = sphere_pdf{};
         sres.skip_pdf = false;
         return true;
     }
@@ -169,4 +188,9 @@ struct isotropic : material
     {
         return 1.f / (4.f * pi);
     }
+
+    auto surface_albedo(const hit_result &res) const -> color override
+    {
+        return tex->value(res.u, res.v, res.p);
+    }
 };
\ No newline at end of file
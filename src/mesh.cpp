@@ -0,0 +1,185 @@
+#include "mesh.hpp"
+
+#include <cmath>
+#include <utility>
+
+namespace
+{
+    // Ray set up for the watertight ray/triangle test of Woop, Benthin and Wald (JCGT 2013): vertices
+    // are sheared into a space where the ray runs along +z, so edges shared by two triangles are
+    // evaluated identically from both sides and rays cannot slip through between them.
+    struct watertight_ray
+    {
+        vec3 origin;
+        int kx, ky, kz;
+        float sx, sy, sz;
+
+        explicit watertight_ray(const ray &r) : origin(r.origin)
+        {
+            const auto abs_dir = vec3{std::fabsf(r.direction.x), std::fabsf(r.direction.y), std::fabsf(r.direction.z)};
+            kz = abs_dir.x > abs_dir.y ? (abs_dir.x > abs_dir.z ? 0 : 2) : (abs_dir.y > abs_dir.z ? 1 : 2);
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+            // keep the winding order when the ray points down the dominant axis
+            if (r.direction.data[kz] < 0.f)
+                std::swap(kx, ky);
+            sx = r.direction.data[kx] / r.direction.data[kz];
+            sy = r.direction.data[ky] / r.direction.data[kz];
+            sz = 1.f / r.direction.data[kz];
+        }
+
+        // On a hit sets t and the barycentric weights of a, b and c.
+        auto intersect(const vec3 &a, const vec3 &b, const vec3 &c, const interval &ray_t, float &t, vec3 &weights) const -> bool
+        {
+            const auto pa = a - origin;
+            const auto pb = b - origin;
+            const auto pc = c - origin;
+
+            const auto ax = pa.data[kx] - sx * pa.data[kz];
+            const auto ay = pa.data[ky] - sy * pa.data[kz];
+            const auto bx = pb.data[kx] - sx * pb.data[kz];
+            const auto by = pb.data[ky] - sy * pb.data[kz];
+            const auto cx = pc.data[kx] - sx * pc.data[kz];
+            const auto cy = pc.data[ky] - sy * pc.data[kz];
+
+            auto u = cx * by - cy * bx;
+            auto v = ax * cy - ay * cx;
+            auto w = bx * ay - by * ax;
+
+            // exactly on an edge in single precision: decide it in double so neighbours agree
+            if (u == 0.f || v == 0.f || w == 0.f)
+            {
+                u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+                v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+                w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+            }
+
+            if ((u < 0.f || v < 0.f || w < 0.f) && (u > 0.f || v > 0.f || w > 0.f))
+                return false;
+
+            const auto det = u + v + w;
+            if (det == 0.f)
+                return false;
+
+            const auto scaled_t = u * sz * pa.data[kz] + v * sz * pb.data[kz] + w * sz * pc.data[kz];
+            t = scaled_t / det;
+            if (!ray_t.surrounds(t))
+                return false;
+
+            weights = vec3{u, v, w} / det;
+            return true;
+        }
+    };
+}
+
+auto triangle_mesh::from_buffers(mesh_buffers buffers, material_id mat, const bvh_build_options &options) -> triangle_mesh
+{
+    const auto count = buffers.triangle_count();
+    auto prims = std::vector<bvh_build_primitive>(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto a = buffers.position(buffers.indices[3 * i]);
+        const auto b = buffers.position(buffers.indices[3 * i + 1]);
+        const auto c = buffers.position(buffers.indices[3 * i + 2]);
+        const auto bounds = aabb::from_aabbs(aabb::from_points(a, b), aabb::from_points(c, c));
+        prims[i] = {bounds, bounds.centroid(), static_cast<std::uint32_t>(i)};
+    }
+
+    auto mesh = triangle_mesh{};
+    mesh.tree = bvh_tree::build(std::move(prims), options);
+
+    auto indices = std::vector<std::uint32_t>(3 * count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto source = mesh.tree.order[i];
+        for (std::size_t k = 0; k < 3; ++k)
+            indices[3 * i + k] = buffers.indices[3 * source + k];
+    }
+    buffers.indices = std::move(indices);
+    // the order is only needed for the reordering above
+    mesh.tree.order = {};
+
+    mesh.buffers = std::move(buffers);
+    mesh.mat = mat;
+    mesh.first_id = next_primitive_id(static_cast<primitive_id>(count));
+    return mesh;
+}
+
+auto triangle_mesh::intersect(const ray &r, const interval &t, intersection &isect) const -> bool
+{
+    const auto wr = watertight_ray{r};
+    auto closest = std::uint32_t{0};
+    auto closest_t = 0.f;
+    auto weights = vec3{};
+
+    const auto found = tree.traverse(r, t, [&](std::uint32_t first, std::uint32_t count, interval &ray_t)
+                                     {
+        bool hit_anything = false;
+        for (auto i = first; i < first + count; ++i)
+        {
+            const auto *tri = &buffers.indices[3 * i];
+            auto tri_t = 0.f;
+            auto tri_weights = vec3{};
+            if (wr.intersect(buffers.position(tri[0]), buffers.position(tri[1]), buffers.position(tri[2]), ray_t, tri_t, tri_weights))
+            {
+                hit_anything = true;
+                ray_t.max = tri_t;
+                closest = i;
+                closest_t = tri_t;
+                weights = tri_weights;
+            }
+        }
+        return hit_anything; });
+    if (!found)
+        return false;
+
+    isect.set(this, closest_t, weights.y, weights.z, closest);
+    return true;
+}
+
+auto triangle_mesh::compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void
+{
+    const auto weights = vec3{1.f - isect.u - isect.v, isect.u, isect.v};
+    const auto *tri = &buffers.indices[3 * isect.index];
+    const auto a = buffers.position(tri[0]);
+    const auto b = buffers.position(tri[1]);
+    const auto c = buffers.position(tri[2]);
+
+    res.p = weights.x * a + weights.y * b + weights.z * c;
+    const auto geometric = (b - a).cross(c - a).normalized();
+    res.set_face_normal(r, geometric);
+    if (buffers.has_normals())
+    {
+        const auto shading = (weights.x * buffers.normal(tri[0]) + weights.y * buffers.normal(tri[1]) + weights.z * buffers.normal(tri[2])).normalized();
+        res.normal = res.front_face ? shading : -shading;
+    }
+    if (buffers.has_uvs())
+    {
+        res.u = weights.x * buffers.u[tri[0]] + weights.y * buffers.u[tri[1]] + weights.z * buffers.u[tri[2]];
+        res.v = weights.x * buffers.v[tri[0]] + weights.y * buffers.v[tri[1]] + weights.z * buffers.v[tri[2]];
+    }
+    else
+    {
+        res.u = weights.y;
+        res.v = weights.z;
+    }
+    res.velocity = vec3{0, 0, 0};
+    res.mat = mat;
+    res.prim = first_id + static_cast<primitive_id>(isect.index);
+}
+
+auto triangle_mesh::occluded(const ray &r, const interval &t) const -> bool
+{
+    const auto wr = watertight_ray{r};
+    return tree.traverse<true>(r, t, [&](std::uint32_t first, std::uint32_t count, const interval &ray_t)
+                               {
+        for (auto i = first; i < first + count; ++i)
+        {
+            const auto *tri = &buffers.indices[3 * i];
+            auto tri_t = 0.f;
+            auto weights = vec3{};
+            if (wr.intersect(buffers.position(tri[0]), buffers.position(tri[1]), buffers.position(tri[2]), ray_t, tri_t, weights))
+                return true;
+        }
+        return false; });
+}
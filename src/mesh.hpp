@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common.hpp"
+#include "raytraceable.hpp"
+#include "bvh.hpp"
+
+// Vertex attributes as separate per-component arrays, indexed by every triangle that shares the vertex.
+// normals and uvs are either empty or have one entry per position.
+struct mesh_buffers
+{
+    std::vector<float> x{}, y{}, z{};
+    std::vector<float> nx{}, ny{}, nz{};
+    std::vector<float> u{}, v{};
+    std::vector<std::uint32_t> indices{}; // three per triangle
+
+    auto vertex_count() const -> std::size_t { return x.size(); }
+    auto triangle_count() const -> std::size_t { return indices.size() / 3; }
+    auto has_normals() const -> bool { return !nx.empty(); }
+    auto has_uvs() const -> bool { return !u.empty(); }
+
+    auto position(std::uint32_t i) const -> vec3 { return {x[i], y[i], z[i]}; }
+    auto normal(std::uint32_t i) const -> vec3 { return {nx[i], ny[i], nz[i]}; }
+};
+
+// An indexed triangle mesh with its own bvh over the triangles, added to a world as one object.
+// Triangles cost their 12 bytes of indices plus about half a 32 byte bvh node, on top of the shared
+// vertices. Each triangle has its own primitive id.
+struct triangle_mesh : raytraceable
+{
+    mesh_buffers buffers{};
+    bvh_tree tree{};
+    material_id mat = no_material;
+    primitive_id first_id = no_primitive;
+
+    // Builds the bvh over the triangles and reorders buffers.indices to match it.
+    static auto from_buffers(mesh_buffers buffers, material_id mat, const bvh_build_options &options = {}) -> triangle_mesh;
+
+    // Records the closest triangle's index and barycentrics; the normal, uv and the rest are computed
+    // from them by compute_interaction.
+    auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool override;
+    auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void override;
+    auto occluded(const ray &r, const interval &t) const -> bool override;
+    auto bbox() const -> aabb override { return tree.bbox(); }
+};
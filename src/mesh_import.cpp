@@ -0,0 +1,867 @@
+#include "mesh_import.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define RTW_POSIX_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // below this many bytes a file is parsed on the calling thread
+    constexpr std::size_t min_parallel_bytes = 1 << 20;
+
+    // A read-only view of a whole file: mapped on POSIX systems, read into memory elsewhere.
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(const std::filesystem::path &path)
+        {
+#if defined(RTW_POSIX_MMAP)
+            const auto fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat info{};
+            if (::fstat(fd, &info) == 0)
+            {
+                m_size = static_cast<std::size_t>(info.st_size);
+                if (m_size == 0)
+                    m_open = true;
+                else if (auto *mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0); mapping != MAP_FAILED)
+                {
+                    ::madvise(mapping, m_size, MADV_WILLNEED);
+                    m_data = static_cast<const char *>(mapping);
+                    m_mapped = true;
+                    m_open = true;
+                }
+            }
+            ::close(fd);
+#else
+            auto file = std::ifstream{path, std::ios::binary | std::ios::ate};
+            if (!file)
+                return;
+            m_buffer.resize(static_cast<std::size_t>(file.tellg()));
+            file.seekg(0);
+            if (!file.read(m_buffer.data(), m_buffer.size()))
+                return;
+            m_data = m_buffer.data();
+            m_size = m_buffer.size();
+            m_open = true;
+#endif
+        }
+
+        ~mapped_file()
+        {
+#if defined(RTW_POSIX_MMAP)
+            if (m_mapped)
+                ::munmap(const_cast<char *>(m_data), m_size);
+#endif
+        }
+
+        mapped_file(const mapped_file &) = delete;
+        auto operator=(const mapped_file &) -> mapped_file & = delete;
+
+        auto is_open() const -> bool { return m_open; }
+        auto begin() const -> const char * { return m_data; }
+        auto end() const -> const char * { return m_data + m_size; }
+        auto size() const -> std::size_t { return m_size; }
+
+    private:
+        const char *m_data = nullptr;
+        std::size_t m_size = 0;
+        bool m_open = false;
+        bool m_mapped = false;
+        std::vector<char> m_buffer{};
+    };
+
+    // Runs chunk_fn(chunk) for every chunk in [0, chunks), each on its own thread, and returns whether
+    // all of them succeeded.
+    template <typename chunk_fn>
+    auto parallel_chunks(std::size_t chunks, chunk_fn &&chunk) -> bool
+    {
+        auto results = std::vector<char>(chunks, 0);
+        auto workers = std::vector<std::thread>{};
+        workers.reserve(chunks);
+        for (std::size_t c = 1; c < chunks; ++c)
+        {
+            workers.emplace_back([&, c]()
+                                 { results[c] = chunk(c); });
+        }
+        if (chunks > 0)
+            results[0] = chunk(0);
+        for (auto &worker : workers)
+            worker.join();
+        return std::ranges::all_of(results, [](char ok)
+                                   { return ok != 0; });
+    }
+
+    auto chunk_count(std::size_t bytes, std::size_t threads) -> std::size_t
+    {
+        return bytes < min_parallel_bytes ? 1 : std::max<std::size_t>(threads, 1);
+    }
+
+    auto is_blank(char c) -> bool { return c == ' ' || c == '\t' || c == '\r'; }
+
+    auto skip_blanks(const char *p, const char *end) -> const char *
+    {
+        while (p < end && is_blank(*p))
+            ++p;
+        return p;
+    }
+
+    auto line_end(const char *p, const char *end) -> const char *
+    {
+        const auto *newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        return newline != nullptr ? newline : end;
+    }
+
+    auto parse_float(const char *&p, const char *end, float &value) -> bool
+    {
+        p = skip_blanks(p, end);
+        if (p < end && *p == '+')
+            ++p;
+        const auto [next, error] = std::from_chars(p, end, value);
+        if (error != std::errc{})
+            return false;
+        p = next;
+        return true;
+    }
+
+    auto parse_int(const char *&p, const char *end, std::int64_t &value) -> bool
+    {
+        const auto [next, error] = std::from_chars(p, end, value);
+        if (error != std::errc{})
+            return false;
+        p = next;
+        return true;
+    }
+
+    // Splits [begin, end) into `count` ranges that each start at the beginning of a line.
+    auto split_lines(const char *begin, const char *end, std::size_t count) -> std::vector<const char *>
+    {
+        auto bounds = std::vector<const char *>(count + 1, end);
+        bounds[0] = begin;
+        for (std::size_t c = 1; c < count; ++c)
+        {
+            const auto *p = std::max(begin + (end - begin) * c / count, bounds[c - 1]);
+            p = line_end(p, end);
+            bounds[c] = p < end ? p + 1 : end;
+        }
+        return bounds;
+    }
+
+    enum class obj_line
+    {
+        other,
+        position,
+        uv,
+        normal,
+        face,
+    };
+
+    // Classifies the line starting at p and moves p past its keyword.
+    auto classify_obj_line(const char *&p, const char *end) -> obj_line
+    {
+        p = skip_blanks(p, end);
+        if (end - p < 2)
+            return obj_line::other;
+        if (p[0] == 'f' && is_blank(p[1]))
+        {
+            p += 1;
+            return obj_line::face;
+        }
+        if (p[0] != 'v')
+            return obj_line::other;
+        if (is_blank(p[1]))
+        {
+            p += 1;
+            return obj_line::position;
+        }
+        if (end - p >= 3 && is_blank(p[2]))
+        {
+            p += 2;
+            if (p[-1] == 't')
+                return obj_line::uv;
+            if (p[-1] == 'n')
+                return obj_line::normal;
+        }
+        return obj_line::other;
+    }
+
+    struct obj_counts
+    {
+        std::size_t positions = 0;
+        std::size_t uvs = 0;
+        std::size_t normals = 0;
+        std::size_t triangles = 0;
+    };
+
+    auto count_obj_chunk(const char *p, const char *end) -> obj_counts
+    {
+        auto counts = obj_counts{};
+        while (p < end)
+        {
+            const auto *eol = line_end(p, end);
+            switch (classify_obj_line(p, eol))
+            {
+            case obj_line::position:
+                ++counts.positions;
+                break;
+            case obj_line::uv:
+                ++counts.uvs;
+                break;
+            case obj_line::normal:
+                ++counts.normals;
+                break;
+            case obj_line::face:
+            {
+                auto corners = std::size_t{0};
+                while ((p = skip_blanks(p, eol)) < eol && *p != '#')
+                {
+                    ++corners;
+                    while (p < eol && !is_blank(*p))
+                        ++p;
+                }
+                counts.triangles += corners >= 3 ? corners - 2 : 0;
+                break;
+            }
+            case obj_line::other:
+                break;
+            }
+            p = eol + 1;
+        }
+        return counts;
+    }
+
+    // Global 0-based index of a 1-based or negative (relative to `defined` so far) OBJ index, or -1.
+    auto resolve_obj_index(std::int64_t index, std::size_t defined) -> std::int64_t
+    {
+        if (index > 0)
+            return index - 1;
+        if (index < 0)
+            return static_cast<std::int64_t>(defined) + index;
+        return -1;
+    }
+
+    struct obj_chunk_state
+    {
+        obj_counts cursor{}; // where this chunk writes, advanced as it parses
+        bool uvs_match = true;
+        bool normals_match = true;
+    };
+
+    auto parse_obj_chunk(const char *p, const char *end, mesh_buffers &buffers, std::vector<float> &uv_u, std::vector<float> &uv_v, std::vector<float> &normals, std::size_t position_total, obj_chunk_state &state) -> bool
+    {
+        auto &cursor = state.cursor;
+        while (p < end)
+        {
+            const auto *eol = line_end(p, end);
+            switch (classify_obj_line(p, eol))
+            {
+            case obj_line::position:
+            {
+                const auto i = cursor.positions++;
+                if (!parse_float(p, eol, buffers.x[i]) || !parse_float(p, eol, buffers.y[i]) || !parse_float(p, eol, buffers.z[i]))
+                    return false;
+                break;
+            }
+            case obj_line::uv:
+            {
+                const auto i = cursor.uvs++;
+                if (!parse_float(p, eol, uv_u[i]))
+                    return false;
+                if (!parse_float(p, eol, uv_v[i]))
+                    uv_v[i] = 0.f;
+                break;
+            }
+            case obj_line::normal:
+            {
+                const auto i = cursor.normals++;
+                if (!parse_float(p, eol, normals[3 * i]) || !parse_float(p, eol, normals[3 * i + 1]) || !parse_float(p, eol, normals[3 * i + 2]))
+                    return false;
+                break;
+            }
+            case obj_line::face:
+            {
+                // triangle fan around the first corner
+                auto first = std::uint32_t{0};
+                auto previous = std::uint32_t{0};
+                auto corner = std::size_t{0};
+                while ((p = skip_blanks(p, eol)) < eol && *p != '#')
+                {
+                    auto v = std::int64_t{0};
+                    auto vt = std::int64_t{0};
+                    auto vn = std::int64_t{0};
+                    if (!parse_int(p, eol, v))
+                        return false;
+                    if (p < eol && *p == '/')
+                    {
+                        ++p;
+                        if (p < eol && *p != '/' && !parse_int(p, eol, vt))
+                            return false;
+                        if (p < eol && *p == '/')
+                        {
+                            ++p;
+                            if (!parse_int(p, eol, vn))
+                                return false;
+                        }
+                    }
+                    if (p < eol && !is_blank(*p))
+                        return false;
+
+                    const auto position = resolve_obj_index(v, cursor.positions);
+                    if (position < 0 || static_cast<std::size_t>(position) >= position_total)
+                        return false;
+                    state.uvs_match &= vt != 0 && resolve_obj_index(vt, cursor.uvs) == position;
+                    state.normals_match &= vn != 0 && resolve_obj_index(vn, cursor.normals) == position;
+
+                    const auto index = static_cast<std::uint32_t>(position);
+                    if (corner == 0)
+                        first = index;
+                    else if (corner >= 2)
+                    {
+                        const auto t = cursor.triangles++;
+                        buffers.indices[3 * t] = first;
+                        buffers.indices[3 * t + 1] = previous;
+                        buffers.indices[3 * t + 2] = index;
+                    }
+                    previous = index;
+                    ++corner;
+                }
+                break;
+            }
+            case obj_line::other:
+                break;
+            }
+            p = eol + 1;
+        }
+        return true;
+    }
+
+    enum class ply_type
+    {
+        none,
+        int8,
+        uint8,
+        int16,
+        uint16,
+        int32,
+        uint32,
+        float32,
+        float64,
+    };
+
+    auto ply_type_from_name(std::string_view name) -> ply_type
+    {
+        if (name == "char" || name == "int8")
+            return ply_type::int8;
+        if (name == "uchar" || name == "uint8")
+            return ply_type::uint8;
+        if (name == "short" || name == "int16")
+            return ply_type::int16;
+        if (name == "ushort" || name == "uint16")
+            return ply_type::uint16;
+        if (name == "int" || name == "int32")
+            return ply_type::int32;
+        if (name == "uint" || name == "uint32")
+            return ply_type::uint32;
+        if (name == "float" || name == "float32")
+            return ply_type::float32;
+        if (name == "double" || name == "float64")
+            return ply_type::float64;
+        return ply_type::none;
+    }
+
+    auto ply_type_size(ply_type type) -> std::size_t
+    {
+        switch (type)
+        {
+        case ply_type::int8:
+        case ply_type::uint8:
+            return 1;
+        case ply_type::int16:
+        case ply_type::uint16:
+            return 2;
+        case ply_type::int32:
+        case ply_type::uint32:
+        case ply_type::float32:
+            return 4;
+        case ply_type::float64:
+            return 8;
+        case ply_type::none:
+            break;
+        }
+        return 0;
+    }
+
+    template <typename raw>
+    auto load_raw(const char *p, bool swap) -> raw
+    {
+        using bits = std::conditional_t<sizeof(raw) == 1, std::uint8_t, std::conditional_t<sizeof(raw) == 2, std::uint16_t, std::conditional_t<sizeof(raw) == 4, std::uint32_t, std::uint64_t>>>;
+        auto value = bits{};
+        std::memcpy(&value, p, sizeof(value));
+        if (swap)
+            value = std::byteswap(value);
+        return std::bit_cast<raw>(value);
+    }
+
+    template <typename T>
+    auto read_ply(const char *p, ply_type type, bool swap) -> T
+    {
+        switch (type)
+        {
+        case ply_type::int8:
+            return static_cast<T>(load_raw<std::int8_t>(p, swap));
+        case ply_type::uint8:
+            return static_cast<T>(load_raw<std::uint8_t>(p, swap));
+        case ply_type::int16:
+            return static_cast<T>(load_raw<std::int16_t>(p, swap));
+        case ply_type::uint16:
+            return static_cast<T>(load_raw<std::uint16_t>(p, swap));
+        case ply_type::int32:
+            return static_cast<T>(load_raw<std::int32_t>(p, swap));
+        case ply_type::uint32:
+            return static_cast<T>(load_raw<std::uint32_t>(p, swap));
+        case ply_type::float32:
+            return static_cast<T>(load_raw<float>(p, swap));
+        case ply_type::float64:
+            return static_cast<T>(load_raw<double>(p, swap));
+        case ply_type::none:
+            break;
+        }
+        return T{};
+    }
+
+    struct ply_property
+    {
+        std::string_view name;
+        ply_type type = ply_type::none;
+        ply_type count_type = ply_type::none; // set for list properties
+        std::size_t offset = 0;               // from the start of the item, for elements without lists
+    };
+
+    struct ply_element
+    {
+        std::string_view name;
+        std::size_t count = 0;
+        std::vector<ply_property> properties{};
+        std::size_t stride = 0; // item size, 0 when the element has lists
+
+        auto find(std::string_view property) const -> const ply_property *
+        {
+            const auto it = std::ranges::find(properties, property, &ply_property::name);
+            return it != std::end(properties) ? &*it : nullptr;
+        }
+    };
+
+    // Splits a header line into whitespace separated words.
+    auto words(std::string_view line) -> std::vector<std::string_view>
+    {
+        auto result = std::vector<std::string_view>{};
+        auto p = std::size_t{0};
+        while (true)
+        {
+            p = line.find_first_not_of(" \t\r", p);
+            if (p == std::string_view::npos)
+                break;
+            const auto e = std::min(line.find_first_of(" \t\r", p), line.size());
+            result.push_back(line.substr(p, e - p));
+            p = e;
+        }
+        return result;
+    }
+
+    // Size of the list-bearing item at p, or 0 when it runs past end.
+    auto ply_item_size(const ply_element &element, const char *p, const char *end, bool swap) -> std::size_t
+    {
+        auto size = std::size_t{0};
+        for (const auto &property : element.properties)
+        {
+            if (property.count_type == ply_type::none)
+            {
+                size += ply_type_size(property.type);
+                continue;
+            }
+            const auto count_size = ply_type_size(property.count_type);
+            if (end - p < static_cast<std::ptrdiff_t>(size + count_size))
+                return 0;
+            const auto count = read_ply<std::size_t>(p + size, property.count_type, swap);
+            size += count_size + count * ply_type_size(property.type);
+        }
+        return end - p < static_cast<std::ptrdiff_t>(size) ? 0 : size;
+    }
+
+    struct ply_face_chunk
+    {
+        const char *start = nullptr;
+        std::size_t first_face = 0;
+        std::size_t first_triangle = 0;
+    };
+}
+
+auto load_obj(const std::filesystem::path &path, mesh_buffers &buffers, std::size_t threads) -> bool
+{
+    const auto file = mapped_file{path};
+    if (!file.is_open())
+    {
+        std::println("failed to open {}", path.string());
+        return false;
+    }
+
+    const auto chunks = chunk_count(file.size(), threads);
+    const auto bounds = split_lines(file.begin(), file.end(), chunks);
+
+    // first pass: what every chunk defines, so the second pass knows where to write
+    auto counts = std::vector<obj_counts>(chunks);
+    parallel_chunks(chunks, [&](std::size_t c)
+                    { counts[c] = count_obj_chunk(bounds[c], bounds[c + 1]); return true; });
+
+    auto states = std::vector<obj_chunk_state>(chunks);
+    auto total = obj_counts{};
+    for (std::size_t c = 0; c < chunks; ++c)
+    {
+        states[c].cursor = total;
+        total.positions += counts[c].positions;
+        total.uvs += counts[c].uvs;
+        total.normals += counts[c].normals;
+        total.triangles += counts[c].triangles;
+    }
+
+    auto result = mesh_buffers{};
+    result.x.resize(total.positions);
+    result.y.resize(total.positions);
+    result.z.resize(total.positions);
+    result.indices.resize(3 * total.triangles);
+    auto uv_u = std::vector<float>(total.uvs);
+    auto uv_v = std::vector<float>(total.uvs);
+    auto normals = std::vector<float>(3 * total.normals);
+
+    const auto parsed = parallel_chunks(chunks, [&](std::size_t c)
+                                        { return parse_obj_chunk(bounds[c], bounds[c + 1], result, uv_u, uv_v, normals, total.positions, states[c]); });
+    if (!parsed)
+    {
+        std::println("malformed vertex or face in {}", path.string());
+        return false;
+    }
+
+    const auto uvs_match = std::ranges::all_of(states, &obj_chunk_state::uvs_match);
+    if (uvs_match && total.uvs == total.positions)
+    {
+        result.u = std::move(uv_u);
+        result.v = std::move(uv_v);
+    }
+    const auto normals_match = std::ranges::all_of(states, &obj_chunk_state::normals_match);
+    if (normals_match && total.normals == total.positions)
+    {
+        result.nx.resize(total.normals);
+        result.ny.resize(total.normals);
+        result.nz.resize(total.normals);
+        for (std::size_t i = 0; i < total.normals; ++i)
+        {
+            result.nx[i] = normals[3 * i];
+            result.ny[i] = normals[3 * i + 1];
+            result.nz[i] = normals[3 * i + 2];
+        }
+    }
+
+    buffers = std::move(result);
+    return true;
+}
+
+auto load_ply(const std::filesystem::path &path, mesh_buffers &buffers, std::size_t threads) -> bool
+{
+    const auto file = mapped_file{path};
+    if (!file.is_open())
+    {
+        std::println("failed to open {}", path.string());
+        return false;
+    }
+    const auto fail = [&](std::string_view reason)
+    {
+        std::println("{}: {}", path.string(), reason);
+        return false;
+    };
+
+    // header
+    auto elements = std::vector<ply_element>{};
+    auto swap = false;
+    auto binary = false;
+    const auto *p = file.begin();
+    auto first_line = true;
+    while (true)
+    {
+        if (p >= file.end())
+            return fail("missing end_header");
+        const auto *eol = line_end(p, file.end());
+        const auto line = words(std::string_view{p, static_cast<std::size_t>(eol - p)});
+        p = eol + 1;
+
+        if (first_line)
+        {
+            if (line.size() != 1 || line[0] != "ply")
+                return fail("not a PLY file");
+            first_line = false;
+            continue;
+        }
+        if (line.empty() || line[0] == "comment" || line[0] == "obj_info")
+            continue;
+        if (line[0] == "end_header")
+            break;
+        if (line[0] == "format" && line.size() >= 2)
+        {
+            binary = line[1] != "ascii";
+            swap = (line[1] == "binary_big_endian") != (std::endian::native == std::endian::big);
+        }
+        else if (line[0] == "element" && line.size() == 3)
+        {
+            auto element = ply_element{line[1]};
+            auto count = std::int64_t{0};
+            const auto *digits = line[2].data();
+            if (!parse_int(digits, line[2].data() + line[2].size(), count) || count < 0)
+                return fail("bad element count");
+            element.count = static_cast<std::size_t>(count);
+            elements.push_back(element);
+        }
+        else if (line[0] == "property" && !elements.empty())
+        {
+            auto property = ply_property{};
+            if (line.size() == 5 && line[1] == "list")
+                property = {line[4], ply_type_from_name(line[3]), ply_type_from_name(line[2])};
+            else if (line.size() == 3)
+                property = {line[2], ply_type_from_name(line[1])};
+            if (property.type == ply_type::none || (line[1] == "list" && property.count_type == ply_type::none))
+                return fail("unsupported property");
+            elements.back().properties.push_back(property);
+        }
+        else
+            return fail("unsupported header line");
+    }
+    if (!binary)
+        return fail("only binary PLY files are supported");
+
+    for (auto &element : elements)
+    {
+        auto offset = std::size_t{0};
+        auto has_lists = false;
+        for (auto &property : element.properties)
+        {
+            has_lists |= property.count_type != ply_type::none;
+            property.offset = offset;
+            offset += ply_type_size(property.type);
+        }
+        element.stride = has_lists ? 0 : offset;
+    }
+
+    // locate the vertex and face data, splitting the faces into chunks on the way
+    const ply_element *vertices = nullptr;
+    const char *vertex_data = nullptr;
+    const ply_element *faces = nullptr;
+    const ply_property *face_indices = nullptr;
+    auto face_chunks = std::vector<ply_face_chunk>{};
+    auto triangle_total = std::size_t{0};
+    for (const auto &element : elements)
+    {
+        if (element.name == "vertex")
+        {
+            if (element.stride == 0)
+                return fail("vertex lists are not supported");
+            vertices = &element;
+            vertex_data = p;
+        }
+
+        if (element.name == "face")
+        {
+            faces = &element;
+            face_indices = element.find("vertex_indices");
+            if (face_indices == nullptr)
+                face_indices = element.find("vertex_index");
+            if (face_indices == nullptr || face_indices->count_type == ply_type::none)
+                return fail("faces without a vertex_indices list");
+
+            // face sizes vary, so this walk is sequential; it only reads the list counts
+            const auto chunks = chunk_count(static_cast<std::size_t>(file.end() - p), threads);
+            const auto faces_per_chunk = (element.count + chunks - 1) / std::max<std::size_t>(chunks, 1);
+            for (std::size_t f = 0; f < element.count; ++f)
+            {
+                if (f % std::max<std::size_t>(faces_per_chunk, 1) == 0)
+                    face_chunks.push_back({p, f, triangle_total});
+                auto size = std::size_t{0};
+                for (const auto &property : element.properties)
+                {
+                    if (property.count_type == ply_type::none)
+                    {
+                        size += ply_type_size(property.type);
+                        continue;
+                    }
+                    const auto count_size = ply_type_size(property.count_type);
+                    if (file.end() - p < static_cast<std::ptrdiff_t>(size + count_size))
+                        return fail("truncated face data");
+                    const auto count = read_ply<std::size_t>(p + size, property.count_type, swap);
+                    if (&property == face_indices)
+                        triangle_total += count >= 3 ? count - 2 : 0;
+                    size += count_size + count * ply_type_size(property.type);
+                }
+                if (file.end() - p < static_cast<std::ptrdiff_t>(size))
+                    return fail("truncated face data");
+                p += size;
+            }
+            continue;
+        }
+
+        if (element.stride != 0)
+        {
+            if (static_cast<std::size_t>(file.end() - p) / element.stride < element.count)
+                return fail("truncated element data");
+            p += element.count * element.stride;
+            continue;
+        }
+        for (std::size_t i = 0; i < element.count; ++i)
+        {
+            const auto size = ply_item_size(element, p, file.end(), swap);
+            if (size == 0)
+                return fail("truncated element data");
+            p += size;
+        }
+    }
+    if (vertices == nullptr || faces == nullptr)
+        return fail("missing vertex or face element");
+
+    const auto *px = vertices->find("x");
+    const auto *py = vertices->find("y");
+    const auto *pz = vertices->find("z");
+    if (px == nullptr || py == nullptr || pz == nullptr)
+        return fail("vertices without x, y and z");
+    const auto *nx = vertices->find("nx");
+    const auto *ny = vertices->find("ny");
+    const auto *nz = vertices->find("nz");
+    const auto has_normals = nx != nullptr && ny != nullptr && nz != nullptr;
+    const ply_property *pu = nullptr;
+    const ply_property *pv = nullptr;
+    for (const auto &[u_name, v_name] : {std::pair{"u", "v"}, std::pair{"s", "t"}, std::pair{"texture_u", "texture_v"}})
+    {
+        if (pu == nullptr || pv == nullptr)
+        {
+            pu = vertices->find(u_name);
+            pv = vertices->find(v_name);
+        }
+    }
+    const auto has_uvs = pu != nullptr && pv != nullptr;
+
+    const auto vertex_count = vertices->count;
+    auto result = mesh_buffers{};
+    result.x.resize(vertex_count);
+    result.y.resize(vertex_count);
+    result.z.resize(vertex_count);
+    if (has_normals)
+    {
+        result.nx.resize(vertex_count);
+        result.ny.resize(vertex_count);
+        result.nz.resize(vertex_count);
+    }
+    if (has_uvs)
+    {
+        result.u.resize(vertex_count);
+        result.v.resize(vertex_count);
+    }
+    result.indices.resize(3 * triangle_total);
+
+    // vertices have a fixed stride, so every chunk can find its own start
+    const auto vertex_chunks = chunk_count(vertex_count * vertices->stride, threads);
+    parallel_chunks(vertex_chunks, [&](std::size_t c)
+                    {
+        const auto first = vertex_count * c / vertex_chunks;
+        const auto last = vertex_count * (c + 1) / vertex_chunks;
+        for (auto i = first; i < last; ++i)
+        {
+            const auto *item = vertex_data + i * vertices->stride;
+            result.x[i] = read_ply<float>(item + px->offset, px->type, swap);
+            result.y[i] = read_ply<float>(item + py->offset, py->type, swap);
+            result.z[i] = read_ply<float>(item + pz->offset, pz->type, swap);
+            if (has_normals)
+            {
+                result.nx[i] = read_ply<float>(item + nx->offset, nx->type, swap);
+                result.ny[i] = read_ply<float>(item + ny->offset, ny->type, swap);
+                result.nz[i] = read_ply<float>(item + nz->offset, nz->type, swap);
+            }
+            if (has_uvs)
+            {
+                result.u[i] = read_ply<float>(item + pu->offset, pu->type, swap);
+                result.v[i] = read_ply<float>(item + pv->offset, pv->type, swap);
+            }
+        }
+        return true; });
+
+    const auto parsed = parallel_chunks(face_chunks.size(), [&](std::size_t c)
+                                        {
+        const auto &chunk = face_chunks[c];
+        const auto last_face = c + 1 < face_chunks.size() ? face_chunks[c + 1].first_face : faces->count;
+        const auto *item = chunk.start;
+        auto triangle = chunk.first_triangle;
+        for (auto f = chunk.first_face; f < last_face; ++f)
+        {
+            for (const auto &property : faces->properties)
+            {
+                if (property.count_type == ply_type::none)
+                {
+                    item += ply_type_size(property.type);
+                    continue;
+                }
+                const auto count = read_ply<std::size_t>(item, property.count_type, swap);
+                item += ply_type_size(property.count_type);
+                const auto index_size = ply_type_size(property.type);
+                if (&property == face_indices && count >= 3)
+                {
+                    // triangle fan around the first corner
+                    const auto first = read_ply<std::uint32_t>(item, property.type, swap);
+                    if (first >= vertex_count)
+                        return false;
+                    for (std::size_t k = 2; k < count; ++k)
+                    {
+                        const auto previous = read_ply<std::uint32_t>(item + (k - 1) * index_size, property.type, swap);
+                        const auto current = read_ply<std::uint32_t>(item + k * index_size, property.type, swap);
+                        if (previous >= vertex_count || current >= vertex_count)
+                            return false;
+                        result.indices[3 * triangle] = first;
+                        result.indices[3 * triangle + 1] = previous;
+                        result.indices[3 * triangle + 2] = current;
+                        ++triangle;
+                    }
+                }
+                item += count * index_size;
+            }
+        }
+        return true; });
+    if (!parsed)
+        return fail("face index out of range");
+
+    buffers = std::move(result);
+    return true;
+}
+
+auto load_mesh(const std::filesystem::path &path, mesh_buffers &buffers, std::size_t threads) -> bool
+{
+    auto extension = path.extension().string();
+    std::ranges::transform(extension, std::begin(extension), [](unsigned char c)
+                           { return static_cast<char>(std::tolower(c)); });
+    if (extension == ".obj")
+        return load_obj(path, buffers, threads);
+    if (extension == ".ply")
+        return load_ply(path, buffers, threads);
+    std::println("unsupported mesh format {}", path.string());
+    return false;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+#include "mesh.hpp"
+
+// Loads a Wavefront OBJ or binary PLY file, chosen by extension, straight into mesh buffers. The file
+// is memory mapped and parsed in `threads` chunks: a first pass counts the vertices and triangles of
+// every chunk, and a second pass parses each chunk into its slice of the preallocated buffers.
+//
+// OBJ polygons are split into triangle fans and negative (relative) indices are resolved. OBJ normals
+// and uvs are kept only when every corner uses the same index for them as for its position, since
+// mesh buffers share one index between all attributes. PLY files may be little or big endian, with
+// vertex_indices lists of any integer type.
+//
+// Prints the reason and returns false when the file cannot be read or is malformed.
+auto load_mesh(const std::filesystem::path &path, mesh_buffers &buffers, std::size_t threads = 1) -> bool;
+
+auto load_obj(const std::filesystem::path &path, mesh_buffers &buffers, std::size_t threads = 1) -> bool;
+auto load_ply(const std::filesystem::path &path, mesh_buffers &buffers, std::size_t threads = 1) -> bool;
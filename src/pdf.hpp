@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <variant>
+
+#include "common.hpp"
+#include "sampler.hpp"
+
+// The pdfs are small value types combined in a closed std::variant, so a bounce can build and mix
+// them on the stack without touching the heap.
+
+struct sphere_pdf
+{
+    auto value(const vec3 &direction) const -> float { return 1.f / (4.f * pi); }
+    auto generate(sampler &s) const -> vec3 { return vec3::unit_vector(s.get_2d()); }
+};
+
+struct cosine_pdf
+{
+    onb uvw;
+
+    cosine_pdf(const vec3 &w) : uvw{w} {}
+
+    auto value(const vec3 &direction) const -> float
+    {
+        const auto cosine_theta = direction.normalized().dot(uvw.w());
+        return std::fmaxf(0.f, cosine_theta / pi);
+    }
+
+    auto generate(sampler &s) const -> vec3
+    {
+        return uvw.transform(vec3::cosine_direction(s.get_2d()));
+    }
+};
+
+struct raytraceable;
+struct raytraceable_pdf
+{
+    const raytraceable *obj;
+    vec3 origin;
+
+    raytraceable_pdf(const raytraceable &obj, const vec3 &origin) : obj{&obj}, origin{origin} {}
+
+    auto value(const vec3 &direction) const -> float;
+    auto generate(sampler &s) const -> vec3;
+};
+
+using pdf = std::variant<sphere_pdf, cosine_pdf, raytraceable_pdf>;
+
+inline auto pdf_value(const pdf &p, const vec3 &direction) -> float
+{
+    return std::visit([&](const auto &alternative)
+                      { return alternative.value(direction); }, p);
+}
+
+inline auto pdf_generate(const pdf &p, sampler &s) -> vec3
+{
+    return std::visit([&](const auto &alternative)
+                      { return alternative.generate(s); }, p);
+}
+
+struct mixture_pdf
+{
+    std::array<pdf, 2> p;
+
+    mixture_pdf(const pdf &p1, const pdf &p2) : p{p1, p2} {}
+
+    auto value(const vec3 &direction) const -> float
+    {
+        return 0.5f * pdf_value(p[0], direction) + 0.5f * pdf_value(p[1], direction);
+    }
+
+    auto generate(sampler &s) const -> vec3
+    {
+        if (s.get_1d() < 0.5f)
+            return pdf_generate(p[0], s);
+        return pdf_generate(p[1], s);
+    }
+};
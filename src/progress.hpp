@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+inline auto seconds_to_time_display_units(float seconds, float &units, std::string &unit_name) -> void
+{
+    units = seconds;
+    unit_name = "seconds";
+    if (units > 60.f)
+    {
+        units /= 60.f;
+        unit_name = "minutes";
+    }
+    if (units > 60.f)
+    {
+        units /= 60.f;
+        unit_name = "hours";
+    }
+}
+
+// Work done by one render thread. Only that thread writes it, and each sits on its own cache line so
+// the render threads never contend for one.
+struct alignas(64) thread_progress
+{
+    std::atomic<std::uint64_t> samples{0};
+    std::atomic<std::uint64_t> rays{0};
+    std::atomic<std::uint64_t> skipped{0}; // samples pixels that converged early will never take
+
+    auto add(std::uint64_t sample_count, std::uint64_t ray_count, std::uint64_t skipped_count = 0) -> void
+    {
+        samples.store(samples.load(std::memory_order_relaxed) + sample_count, std::memory_order_relaxed);
+        rays.store(rays.load(std::memory_order_relaxed) + ray_count, std::memory_order_relaxed);
+        skipped.store(skipped.load(std::memory_order_relaxed) + skipped_count, std::memory_order_relaxed);
+    }
+};
+
+// Sums the per-thread counters from its own thread and prints throughput and time left every
+// `interval`, keeping console output out of the render loop. Progress is counted in samples out of
+// total_samples, the most the render can still take; samples that converged pixels skip count as done.
+struct progress_reporter
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<thread_progress> threads;
+    std::uint64_t total_samples;
+    std::chrono::milliseconds interval;
+    clock::time_point deadline = clock::time_point::max(); // caps the estimated time left
+
+    progress_reporter(std::size_t thread_count, std::uint64_t total_samples, std::chrono::milliseconds interval)
+        : threads(thread_count), total_samples{total_samples}, interval{interval}
+    {
+    }
+
+    ~progress_reporter() { stop(); }
+
+    auto start() -> void
+    {
+        start_time = clock::now();
+        reporter = std::thread([this]()
+                               { run(); });
+    }
+
+    auto stop() -> void
+    {
+        if (!reporter.joinable())
+            return;
+        {
+            auto lock = std::lock_guard{mutex};
+            stopping = true;
+        }
+        wake.notify_one();
+        reporter.join();
+    }
+
+    // Stops reporting after a render that ran to its end, including one cut short by its deadline,
+    // and prints a last report at 100%.
+    auto finish() -> void
+    {
+        stop();
+        finished = true;
+        report();
+    }
+
+    auto skipped_samples() const -> std::uint64_t
+    {
+        auto sum = std::uint64_t{0};
+        for (const auto &t : threads)
+            sum += t.skipped.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    auto samples_done() const -> std::uint64_t
+    {
+        auto sum = std::uint64_t{0};
+        for (const auto &t : threads)
+            sum += t.samples.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    auto rays_done() const -> std::uint64_t
+    {
+        auto sum = std::uint64_t{0};
+        for (const auto &t : threads)
+            sum += t.rays.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    clock::time_point start_time{};
+    std::thread reporter{};
+    std::mutex mutex{};
+    std::condition_variable wake{};
+    bool stopping = false;
+    bool finished = false;
+
+    auto run() -> void
+    {
+        auto lock = std::unique_lock{mutex};
+        while (!wake.wait_for(lock, interval, [this]()
+                              { return stopping; }))
+        {
+            report();
+        }
+    }
+
+    auto report() const -> void
+    {
+        const auto samples = samples_done();
+        const auto done = samples + skipped_samples();
+        if (done == 0 && !finished)
+            return;
+
+        const auto now = clock::now();
+        const auto elapsed = std::chrono::duration<float>(now - start_time).count();
+        const auto fraction = finished || total_samples == 0 ? 1.f : std::min(static_cast<float>(done) / total_samples, 1.f);
+        const auto samples_per_second = samples / elapsed;
+        const auto rays_per_second = rays_done() / elapsed;
+
+        auto time_left = fraction > 0.f ? elapsed * (1.f - fraction) / fraction : 0.f;
+        if (deadline != clock::time_point::max())
+            time_left = std::min(time_left, std::max(std::chrono::duration<float>(deadline - now).count(), 0.f));
+        std::string time_unit = "seconds";
+        seconds_to_time_display_units(time_left, time_left, time_unit);
+        std::println("{:.1f}% in {:.0f}s, {:.2f}M samples/s, {:.2f}M rays/s, estimated {:.1f} {} left", 100.f * fraction, elapsed, samples_per_second * 1e-6f, rays_per_second * 1e-6f, time_left, time_unit);
+    }
+};
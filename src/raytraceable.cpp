@@ -1,6 +1,49 @@
 #include "raytraceable.hpp"
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
 
 auto world::optimize() -> void
 {
-    objs = std::vector<std::shared_ptr<raytraceable>>{std::make_shared<bvh_node>(bvh_node::from_world(*this))};
+    optimize(bvh_build_options{});
+}
+
+auto build_bvh(const world &w, const bvh_build_options &options) -> std::shared_ptr<bvh>
+{
+    auto binary = bvh::from_world(w, options);
+    auto accel = std::shared_ptr<bvh>{};
+    if (options.width == 8)
+        accel = std::make_shared<wide_bvh<8>>(wide_bvh<8>::from_bvh(std::move(binary)));
+    else if (options.width == 4)
+        accel = std::make_shared<wide_bvh<4>>(wide_bvh<4>::from_bvh(std::move(binary)));
+    else
+        accel = std::make_shared<bvh>(std::move(binary));
+    accel->build_cost = accel->refit();
+    return accel;
+}
+
+auto world::optimize(const bvh_build_options &options) -> void
+{
+    objs = std::vector<std::shared_ptr<raytraceable>>{build_bvh(*this, options)};
+}
+
+auto world::refit(const bvh_build_options &options, float rebuild_threshold) -> bool
+{
+    auto *accel = objs.size() == 1 ? dynamic_cast<bvh *>(objs[0].get()) : nullptr;
+    if (accel == nullptr)
+    {
+        m_bbox = aabb::empty;
+        for (const auto &obj : objs)
+            m_bbox = aabb::from_aabbs(m_bbox, obj->bbox());
+        return false;
+    }
+
+    const auto cost = accel->refit();
+    m_bbox = accel->bbox();
+    if (cost <= rebuild_threshold * accel->build_cost)
+        return false;
+
+    auto primitives = std::move(accel->objs);
+    objs = std::move(primitives);
+    optimize(options);
+    return true;
 }
\ No newline at end of file
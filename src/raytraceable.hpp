@@ -7,17 +7,43 @@
 
 #include "common.hpp"
 #include "hit_result.hpp"
+#include "sampler.hpp"
 #include "material.hpp"
 
-struct material;
+struct bvh_build_options;
 
 struct raytraceable
 {
     virtual ~raytraceable() = default;
-    virtual auto hit(const ray &r, const interval &t, hit_result &res) const -> bool = 0;
+    // Finds the closest hit within t and records it in isect, leaving isect alone when there is none.
+    // Computes no surface attributes, so candidates that a closer hit later replaces cost little.
+    virtual auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool = 0;
+    // Fills res for a hit that intersect recorded. Called on isect.path[level], with r in that
+    // object's space; transforms call the level below them and map its result back. Objects that only
+    // hold others, like world and bvh, never record themselves and keep this default.
+    virtual auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void {}
+    // Whether anything blocks the ray within t. Stops at the first hit and computes no surface attributes.
+    virtual auto occluded(const ray &r, const interval &t) const -> bool
+    {
+        auto isect = intersection{};
+        return intersect(r, t, isect);
+    }
     virtual auto bbox() const -> aabb = 0;
     virtual auto pdf_value(const vec3 &origin, const vec3 &direction) const -> float { return 0.f; }
-    virtual auto random(const vec3 &origin) const -> vec3 { return vec3{1.f, 0.f, 0.f}; }
+    virtual auto random(const vec3 &origin, sampler &s) const -> vec3 { return vec3{1.f, 0.f, 0.f}; }
+
+    // The closest hit within t with all its surface attributes, computed only for that one hit. Media
+    // take their scattering distance from s, or from randf() when none is given.
+    auto hit(const ray &r, const interval &t, hit_result &res, sampler *s = nullptr) const -> bool
+    {
+        auto isect = intersection{};
+        isect.medium_sampler = s;
+        if (!intersect(r, t, isect))
+            return false;
+        isect.path[isect.depth - 1]->compute_interaction(r, isect, isect.depth - 1, res);
+        res.t = isect.t;
+        return true;
+    }
 };
 
 struct translate : raytraceable
@@ -32,19 +58,33 @@ struct translate : raytraceable
         m_bbox = object->bbox() + offset;
     }
 
-    auto hit(const ray &r, const interval &ray_t, hit_result &res) const -> bool override
+    auto intersect(const ray &r, const interval &ray_t, intersection &isect) const -> bool override
     {
         // Move the ray backwards by the offset
         ray offset_r{r.origin - offset, r.direction, r.time};
 
-        // Determine whether an intersection exists along the offset ray (and if so, where)
-        if (!object->hit(offset_r, ray_t, res))
+        // Determine whether an intersection exists along the offset ray
+        auto inner = intersection{};
+        inner.medium_sampler = isect.medium_sampler;
+        if (!object->intersect(offset_r, ray_t, inner))
             return false;
 
+        isect = inner;
+        isect.push(this);
+        return true;
+    }
+
+    auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void override
+    {
+        isect.path[level - 1]->compute_interaction(ray{r.origin - offset, r.direction, r.time}, isect, level - 1, res);
+
         // Move the intersection point forwards by the offset
         res.p += offset;
+    }
 
-        return true;
+    auto occluded(const ray &r, const interval &ray_t) const -> bool override
+    {
+        return object->occluded(ray{r.origin - offset, r.direction, r.time}, ray_t);
     }
 
     auto bbox() const -> aabb override { return m_bbox; }
@@ -54,7 +94,7 @@ struct translate : raytraceable
         return object->pdf_value(origin - offset, direction);
     }
 
-    auto random(const vec3 &origin) const -> vec3 override { return object->random(origin - offset); }
+    auto random(const vec3 &origin, sampler &s) const -> vec3 override { return object->random(origin - offset, s); }
 };
 
 struct rotate_y : raytraceable
@@ -100,11 +140,9 @@ struct rotate_y : raytraceable
         m_bbox = aabb::from_points(min, max);
     }
 
-    auto hit(const ray &r, const interval &ray_t, hit_result &res) const -> bool override
+    // Transform the ray from world space to object space.
+    auto to_object(const ray &r) const -> ray
     {
-
-        // Transform the ray from world space to object space.
-
         auto origin = vec3{
             (cos_theta * r.origin.x) - (sin_theta * r.origin.z),
             r.origin.y,
@@ -115,13 +153,26 @@ struct rotate_y : raytraceable
             r.direction.y,
             (sin_theta * r.direction.x) + (cos_theta * r.direction.z)};
 
-        ray rotated_r{origin, direction, r.time};
-
-        // Determine whether an intersection exists in object space (and if so, where).
+        return ray{origin, direction, r.time};
+    }
 
-        if (!object->hit(rotated_r, ray_t, res))
+    auto intersect(const ray &r, const interval &ray_t, intersection &isect) const -> bool override
+    {
+        // Determine whether an intersection exists in object space.
+        auto inner = intersection{};
+        inner.medium_sampler = isect.medium_sampler;
+        if (!object->intersect(to_object(r), ray_t, inner))
             return false;
 
+        isect = inner;
+        isect.push(this);
+        return true;
+    }
+
+    auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void override
+    {
+        isect.path[level - 1]->compute_interaction(to_object(r), isect, level - 1, res);
+
         // Transform the intersection from object space back to world space.
 
         res.p = vec3{
@@ -134,7 +185,15 @@ struct rotate_y : raytraceable
             res.normal.y,
             (-sin_theta * res.normal.x) + (cos_theta * res.normal.z)};
 
-        return true;
+        res.velocity = vec3{
+            (cos_theta * res.velocity.x) + (sin_theta * res.velocity.z),
+            res.velocity.y,
+            (-sin_theta * res.velocity.x) + (cos_theta * res.velocity.z)};
+    }
+
+    auto occluded(const ray &r, const interval &ray_t) const -> bool override
+    {
+        return object->occluded(to_object(r), ray_t);
     }
 
     aabb bbox() const override { return m_bbox; }
@@ -144,12 +203,22 @@ struct rotate_y : raytraceable
         return object->pdf_value(origin, direction);
     }
 
-    auto random(const vec3 &origin) const -> vec3 override { return object->random(origin); }
+    auto random(const vec3 &origin, sampler &s) const -> vec3 override { return object->random(origin, s); }
 };
 
 struct world : raytraceable
 {
     std::vector<std::shared_ptr<raytraceable>> objs{};
+    // Primitives refer to these by material_id. Only the world that is rendered needs to own them.
+    std::vector<std::shared_ptr<material>> materials{};
+
+    auto add_material(std::shared_ptr<material> mat) -> material_id
+    {
+        materials.emplace_back(mat);
+        return static_cast<material_id>(materials.size() - 1);
+    }
+
+    auto material_of(const hit_result &res) const -> const material & { return *materials[res.mat]; }
 
     auto add(std::shared_ptr<raytraceable> obj) -> void
     {
@@ -157,28 +226,41 @@ struct world : raytraceable
         m_bbox = aabb::from_aabbs(m_bbox, obj->bbox());
     }
 
-    auto hit(const ray &r, const interval &t, hit_result &res) const -> bool override
+    auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool override
     {
-        hit_result temp_res{};
         bool hit_anything = false;
         auto closest = t.max;
 
         for (const auto &obj : objs)
         {
-            if (obj->hit(r, interval{t.min, closest}, temp_res))
+            if (obj->intersect(r, interval{t.min, closest}, isect))
             {
                 hit_anything = true;
-                closest = temp_res.t;
-                res = temp_res;
+                closest = isect.t;
             }
         }
 
         return hit_anything;
     }
 
+    auto occluded(const ray &r, const interval &t) const -> bool override
+    {
+        for (const auto &obj : objs)
+        {
+            if (obj->occluded(r, t))
+                return true;
+        }
+        return false;
+    }
+
     auto bbox() const -> aabb override { return m_bbox; }
 
     auto optimize() -> void;
+    auto optimize(const bvh_build_options &options) -> void;
+    // Call after objects moved. Refits the bvh built by optimize in place, keeping its topology, unless
+    // that leaves its surface area heuristic cost above rebuild_threshold times the cost it was built
+    // with, in which case it is rebuilt. Returns whether it was rebuilt.
+    auto refit(const bvh_build_options &options, float rebuild_threshold = 1.5f) -> bool;
 
     auto pdf_value(const vec3 &origin, const vec3 &direction) const -> float override
     {
@@ -189,9 +271,10 @@ struct world : raytraceable
         return sum;
     }
 
-    auto random(const vec3 &origin) const -> vec3 override
+    auto random(const vec3 &origin, sampler &s) const -> vec3 override
     {
-        return objs[randi(0, objs.size() - 1)]->random(origin);
+        const auto i = std::min(static_cast<std::size_t>(s.get_1d() * objs.size()), objs.size() - 1);
+        return objs[i]->random(origin, s);
     }
 
 private:
@@ -202,31 +285,32 @@ struct sphere : raytraceable
 {
     ray center{};
     float radius = 1;
-    std::shared_ptr<material> mat{};
+    material_id mat = no_material;
+    primitive_id id = no_primitive;
 
     sphere() = default;
 
-    static auto stationary(const vec3 &center, float radius, std::shared_ptr<material> mat)
+    static auto stationary(const vec3 &center, float radius, material_id mat)
     {
-        return moving(center, vec3{0.f, 0.f, 0.f}, radius, mat);
+        return moving(center, center, radius, mat);
     }
 
-    static auto moving(const vec3 &center1, const vec3 &center2, float radius, std::shared_ptr<material> mat) -> sphere
+    static auto moving(const vec3 &center1, const vec3 &center2, float radius, material_id mat) -> sphere
     {
         auto s = sphere();
         s.center = {center1, center2 - center1};
         s.radius = radius;
         s.mat = mat;
+        s.id = next_primitive_id();
         const auto rvec = vec3{radius, radius, radius};
-        const auto box1 = aabb::from_points(s.center.at(0.f) - rvec, s.center.at(1.f) + rvec);
+        const auto box1 = aabb::from_points(s.center.at(0.f) - rvec, s.center.at(0.f) + rvec);
         const auto box2 = aabb::from_points(s.center.at(1.f) - rvec, s.center.at(1.f) + rvec);
         s.m_bbox = aabb::from_aabbs(box1, box2);
         return s;
     }
 
-    auto hit(const ray &r, const interval &t, hit_result &res) const -> bool override
+    auto solve(const ray &r, const interval &t, const vec3 &current_center, float &root) const -> bool
     {
-        auto current_center = center.at(r.time);
         auto oc = current_center - r.origin;
         auto a = r.direction.magnitude_squared();
         auto h = r.direction.dot(oc);
@@ -238,22 +322,42 @@ struct sphere : raytraceable
 
         auto sqrtd = std::sqrtf(discriminant);
 
-        auto root = (h - sqrtd) / a;
+        root = (h - sqrtd) / a;
         if (!t.surrounds(root))
         {
             root = (h + sqrtd) / a;
             if (!t.surrounds(root))
                 return false;
         }
+        return true;
+    }
 
-        res.t = root;
-        res.p = r.at(res.t);
+    auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool override
+    {
+        auto root = 0.f;
+        if (!solve(r, t, center.at(r.time), root))
+            return false;
+
+        isect.set(this, root);
+        return true;
+    }
+
+    auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void override
+    {
+        auto current_center = center.at(r.time);
+        res.p = r.at(isect.t);
         vec3 outward_normal = (res.p - current_center) / radius;
         res.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, res.u, res.v);
+        res.velocity = center.direction;
         res.mat = mat;
+        res.prim = id;
+    }
 
-        return true;
+    auto occluded(const ray &r, const interval &t) const -> bool override
+    {
+        auto root = 0.f;
+        return solve(r, t, center.at(r.time), root);
     }
 
     auto bbox() const -> aabb override
@@ -263,8 +367,7 @@ struct sphere : raytraceable
 
     auto pdf_value(const vec3 &origin, const vec3 &direction) const -> float override
     {
-        hit_result res{};
-        if (!this->hit(ray(origin, direction), interval{0.001f, infinity}, res))
+        if (!occluded(ray(origin, direction), interval{0.001f, infinity}))
         {
             return 0.f;
         }
@@ -276,12 +379,12 @@ struct sphere : raytraceable
         return 1.f / solid_angle;
     }
 
-    auto random(const vec3 &origin) const -> vec3 override
+    auto random(const vec3 &origin, sampler &s) const -> vec3 override
     {
         const auto direction = center.at(0) - origin;
         const auto distance_squared = direction.magnitude_squared();
         const auto uvw = onb{direction};
-        return uvw.transform(random_to_sphere(radius, distance_squared));
+        return uvw.transform(random_to_sphere(radius, distance_squared, s.get_2d()));
     }
 
     static auto get_sphere_uv(const vec3 &p, float &u, float &v) -> void
@@ -293,10 +396,10 @@ struct sphere : raytraceable
         v = theta / pi;
     }
 
-    static auto random_to_sphere(float radius, float distance_squared) -> vec3
+    static auto random_to_sphere(float radius, float distance_squared, const vec2 &u) -> vec3
     {
-        const auto r1 = randf();
-        const auto r2 = randf();
+        const auto r1 = u.x;
+        const auto r2 = u.y;
         const auto z = 1.f + r2 * (std::sqrtf(1.f - radius * radius / distance_squared) - 1.f);
 
         const auto sqrt_inv_z_squared = std::sqrtf(1.f - z * z);
@@ -311,120 +414,20 @@ private:
     aabb m_bbox{};
 };
 
-struct bvh_node : raytraceable
-{
-    std::shared_ptr<raytraceable> left{};
-    std::shared_ptr<raytraceable> right{};
-
-    static auto from_world(world &w) -> bvh_node { return from_world_slice(w, 0, w.objs.size()); }
-
-    static auto from_world_slice(world &w, std::size_t start, std::size_t end) -> bvh_node
-    {
-        auto node = bvh_node{};
-
-        auto bbox = aabb::empty;
-
-        for (std::size_t i = start; i < end; ++i)
-        {
-            bbox = aabb::from_aabbs(bbox, w.objs[i]->bbox());
-        }
-        node.m_bbox = bbox;
-
-        int axis = bbox.longest_axis();
-
-        auto comparator = (axis == 0)   ? box_x_compare
-                          : (axis == 1) ? box_y_compare
-                                        : box_z_compare;
-
-        size_t object_span = end - start;
-
-        if (object_span == 1)
-        {
-            node.left = node.right = w.objs[start];
-        }
-        else if (object_span == 2)
-        {
-            node.left = w.objs[start];
-            node.right = w.objs[start + 1];
-        }
-        else
-        {
-            std::sort(std::begin(w.objs) + start, std::begin(w.objs) + end, comparator);
-
-            auto mid = start + object_span / 2;
-            node.left = std::make_shared<bvh_node>(bvh_node::from_world_slice(w, start, mid));
-            node.right = std::make_shared<bvh_node>(bvh_node::from_world_slice(w, mid, end));
-        }
-
-        return node;
-    }
-
-    auto hit(const ray &r, const interval &t, hit_result &res) const -> bool override
-    {
-        if (!m_bbox.hit(r, t))
-            return false;
-
-        bool hit_left = left->hit(r, t, res);
-        bool hit_right = right->hit(r, interval{t.min, hit_left ? res.t : t.max}, res);
-
-        return hit_left || hit_right;
-    }
-
-    auto bbox() const -> aabb override { return m_bbox; }
-
-    auto pdf_value(const vec3 &origin, const vec3 &direction) const -> float override
-    {
-        return 0.5f * (left->pdf_value(origin, direction) + right->pdf_value(origin, direction));
-    }
-
-    auto random(const vec3 &origin) const -> vec3 override
-    {
-        if (randf() < 0.5f)
-            return left->random(origin);
-        else
-            return right->random(origin);
-    }
-
-private:
-    aabb m_bbox{};
-
-    static bool box_compare(
-        const std::shared_ptr<raytraceable> a, const std::shared_ptr<raytraceable> b, int axis_index)
-    {
-        auto a_axis_interval = a->bbox().axis_interval(axis_index);
-        auto b_axis_interval = b->bbox().axis_interval(axis_index);
-        return a_axis_interval.min < b_axis_interval.min;
-    }
-
-    static bool box_x_compare(const std::shared_ptr<raytraceable> a, const std::shared_ptr<raytraceable> b)
-    {
-        return box_compare(a, b, 0);
-    }
-
-    static bool box_y_compare(const std::shared_ptr<raytraceable> a, const std::shared_ptr<raytraceable> b)
-    {
-        return box_compare(a, b, 1);
-    }
-
-    static bool box_z_compare(const std::shared_ptr<raytraceable> a, const std::shared_ptr<raytraceable> b)
-    {
-        return box_compare(a, b, 2);
-    }
-};
-
 struct quad : raytraceable
 {
     vec3 q;
     vec3 u, v;
     vec3 w;
-    std::shared_ptr<material> mat;
+    material_id mat;
+    primitive_id id;
     aabb m_bbox;
     vec3 normal;
     float d;
     float area;
 
-    quad(const vec3 &q, const vec3 &u, const vec3 &v, std::shared_ptr<material> mat)
-        : q(q), u(u), v(v), mat(mat)
+    quad(const vec3 &q, const vec3 &u, const vec3 &v, material_id mat)
+        : q(q), u(u), v(v), mat(mat), id(next_primitive_id())
     {
         auto n = u.cross(v);
         normal = n.normalized();
@@ -443,109 +446,103 @@ struct quad : raytraceable
 
     aabb bbox() const override { return m_bbox; }
 
-    auto hit(const ray &r, const interval &ray_t, hit_result &res) const -> bool override
+    // On a hit sets t and the hit point's coordinates along u and v.
+    auto solve(const ray &r, const interval &ray_t, float &t, float &alpha, float &beta) const -> bool
     {
         auto denom = normal.dot(r.direction);
 
         if (std::fabs(denom) < 1e-8)
             return false;
 
-        auto t = (d - normal.dot(r.origin)) / denom;
+        t = (d - normal.dot(r.origin)) / denom;
         if (!ray_t.contains(t))
             return false;
 
         auto intersection = r.at(t);
         vec3 planar_hitpt_vector = intersection - q;
-        auto alpha = w.dot(planar_hitpt_vector.cross(v));
-        auto beta = w.dot(u.cross(planar_hitpt_vector));
+        alpha = w.dot(planar_hitpt_vector.cross(v));
+        beta = w.dot(u.cross(planar_hitpt_vector));
 
-        if (!is_interior(alpha, beta, res))
+        return is_interior(alpha, beta);
+    }
+
+    auto intersect(const ray &r, const interval &ray_t, intersection &isect) const -> bool override
+    {
+        auto t = 0.f;
+        auto alpha = 0.f;
+        auto beta = 0.f;
+        if (!solve(r, ray_t, t, alpha, beta))
             return false;
 
-        res.t = t;
-        res.p = intersection;
+        isect.set(this, t, alpha, beta);
+        return true;
+    }
+
+    auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void override
+    {
+        res.p = r.at(isect.t);
+        res.u = isect.u;
+        res.v = isect.v;
+        res.velocity = vec3{0, 0, 0};
         res.mat = mat;
+        res.prim = id;
         res.set_face_normal(r, normal);
+    }
 
-        return true;
+    auto occluded(const ray &r, const interval &ray_t) const -> bool override
+    {
+        auto t = 0.f;
+        auto alpha = 0.f;
+        auto beta = 0.f;
+        return solve(r, ray_t, t, alpha, beta);
     }
 
-    virtual bool is_interior(float a, float b, hit_result &res) const
+    virtual bool is_interior(float a, float b) const
     {
         interval unit_interval = interval{0, 1};
-
-        if (!unit_interval.contains(a) || !unit_interval.contains(b))
-            return false;
-
-        res.u = a;
-        res.v = b;
-        return true;
+        return unit_interval.contains(a) && unit_interval.contains(b);
     }
 
     virtual auto pdf_value(const vec3 &origin, const vec3 &direction) const -> float override
     {
-        hit_result res{};
-        if (!this->hit(ray{origin, direction}, interval{0.001f, infinity}, res))
+        auto t = 0.f;
+        auto alpha = 0.f;
+        auto beta = 0.f;
+        if (!solve(ray{origin, direction}, interval{0.001f, infinity}, t, alpha, beta))
         {
             return 0.f;
         }
 
-        const auto distance_squared = res.t * res.t * direction.magnitude_squared();
-        const auto cosine = std::fabsf(direction.dot(res.normal) / direction.magnitude());
+        const auto distance_squared = t * t * direction.magnitude_squared();
+        const auto cosine = std::fabsf(direction.dot(normal) / direction.magnitude());
 
         return distance_squared / (cosine * area);
     }
 
-    virtual auto random(const vec3 &origin) const -> vec3 override
+    virtual auto random(const vec3 &origin, sampler &s) const -> vec3 override
     {
-        const auto p = q + (randf() * u) + (randf() * v);
+        const auto st = s.get_2d();
+        const auto p = q + (st.x * u) + (st.y * v);
         return p - origin;
     }
 };
 
-inline std::shared_ptr<world> box(const vec3 &a, const vec3 &b, std::shared_ptr<material> mat)
-{
-    auto sides = std::make_shared<world>();
-
-    auto min = vec3{std::fminf(a.x, b.x), std::fminf(a.y, b.y), std::fminf(a.z, b.z)};
-    auto max = vec3{std::fmaxf(a.x, b.x), std::fmaxf(a.y, b.y), std::fmaxf(a.z, b.z)};
-
-    auto dx = vec3{max.x - min.x, 0, 0};
-    auto dy = vec3{0, max.y - min.y, 0};
-    auto dz = vec3{0, 0, max.z - min.z};
-
-    sides->add(std::make_shared<quad>(vec3{min.x, min.y, max.z}, dx, dy, mat));
-    sides->add(std::make_shared<quad>(vec3{max.x, min.y, max.z}, -dz, dy, mat));
-    sides->add(std::make_shared<quad>(vec3{max.x, min.y, min.z}, -dx, dy, mat));
-    sides->add(std::make_shared<quad>(vec3{min.x, min.y, min.z}, dz, dy, mat));
-    sides->add(std::make_shared<quad>(vec3{min.x, max.y, max.z}, dx, -dz, mat));
-    sides->add(std::make_shared<quad>(vec3{min.x, min.y, min.z}, dx, dz, mat));
-
-    return sides;
-}
-
 struct constant_medium : raytraceable
 {
-    constant_medium(std::shared_ptr<raytraceable> boundary, float density, std::shared_ptr<texture> tex)
-        : boundary(boundary), neg_inv_density(-1 / density),
-          phase_function(std::make_shared<isotropic>(tex))
-    {
-    }
-
-    constant_medium(std::shared_ptr<raytraceable> boundary, float density, const color &albedo)
-        : boundary(boundary), neg_inv_density(-1 / density),
-          phase_function(std::make_shared<isotropic>(albedo))
+    // phase_function should be an isotropic material
+    constant_medium(std::shared_ptr<raytraceable> boundary, float density, material_id phase_function)
+        : boundary(boundary), neg_inv_density(-1 / density), phase_function(phase_function), id(next_primitive_id())
     {
     }
 
-    auto hit(const ray &r, const interval &ray_t, hit_result &rec) const -> bool override
+    auto intersect(const ray &r, const interval &ray_t, intersection &isect) const -> bool override
     {
-        hit_result rec1, rec2;
+        intersection rec1, rec2;
 
-        if (!boundary->hit(r, interval::universe, rec1))
+        if (!boundary->intersect(r, interval::universe, rec1))
             return false;
 
-        if (!boundary->hit(r, interval(rec1.t + 0.0001, infinity), rec2))
+        if (!boundary->intersect(r, interval(rec1.t + 0.0001, infinity), rec2))
             return false;
 
         if (rec1.t < ray_t.min)
@@ -561,19 +558,24 @@ struct constant_medium : raytraceable
 
         auto ray_length = r.direction.magnitude();
         auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
-        auto hit_distance = neg_inv_density * std::logf(randf());
+        auto hit_distance = neg_inv_density * std::logf(isect.medium_sampler ? isect.medium_sampler->get_1d() : randf());
 
         if (hit_distance > distance_inside_boundary)
             return false;
 
-        rec.t = rec1.t + hit_distance / ray_length;
-        rec.p = r.at(rec.t);
+        isect.set(this, rec1.t + hit_distance / ray_length);
+        return true;
+    }
+
+    auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &rec) const -> void override
+    {
+        rec.p = r.at(isect.t);
 
-        rec.normal = vec3{1, 0, 0}; // arbitrary
-        rec.front_face = true;      // also arbitrary
+        rec.normal = -r.direction / r.direction.magnitude(); // any normal works for scattering, facing the ray keeps the denoiser's guide steady
+        rec.front_face = true; // arbitrary
+        rec.velocity = vec3{0, 0, 0};
         rec.mat = phase_function;
-
-        return true;
+        rec.prim = id;
     }
 
     auto bbox() const -> aabb override { return boundary->bbox(); }
@@ -590,7 +592,7 @@ struct constant_medium : raytraceable
         return pdf;
     }
 
-    auto random(const vec3 &o) const -> vec3 override
+    auto random(const vec3 &o, sampler &s) const -> vec3 override
     {
         vec3 direction;
         auto r1 = vec3::random_unit_vector();
@@ -604,5 +606,6 @@ struct constant_medium : raytraceable
 private:
     std::shared_ptr<raytraceable> boundary;
     float neg_inv_density;
-    std::shared_ptr<material> phase_function;
+    material_id phase_function;
+    primitive_id id;
 };
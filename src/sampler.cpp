@@ -0,0 +1,135 @@
+#include "sampler.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    constexpr auto n = blue_noise_sampler::mask_size;
+
+    // Ulichney's void-and-cluster method on a toroidal grid with a gaussian energy filter.
+    struct void_and_cluster
+    {
+        std::vector<float> kernel = std::vector<float>(n * n);
+        std::vector<float> energy = std::vector<float>(n * n);
+        std::vector<bool> pattern = std::vector<bool>(n * n);
+
+        void_and_cluster()
+        {
+            constexpr auto sigma = 1.5f;
+            for (std::size_t y = 0; y < n; ++y)
+            {
+                for (std::size_t x = 0; x < n; ++x)
+                {
+                    const auto dx = static_cast<float>(std::min(x, n - x));
+                    const auto dy = static_cast<float>(std::min(y, n - y));
+                    kernel[y * n + x] = std::expf(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+                }
+            }
+        }
+
+        auto set(std::size_t p, bool value) -> void
+        {
+            pattern[p] = value;
+            const auto sign = value ? 1.f : -1.f;
+            const auto px = p % n;
+            const auto py = p / n;
+            for (std::size_t y = 0; y < n; ++y)
+            {
+                const auto ky = ((y + n - py) % n) * n;
+                for (std::size_t x = 0; x < n; ++x)
+                {
+                    energy[y * n + x] += sign * kernel[ky + (x + n - px) % n];
+                }
+            }
+        }
+
+        auto tightest_cluster() const -> std::size_t
+        {
+            auto best = std::size_t{0};
+            auto best_energy = -infinity;
+            for (std::size_t p = 0; p < n * n; ++p)
+            {
+                if (pattern[p] && energy[p] > best_energy)
+                {
+                    best = p;
+                    best_energy = energy[p];
+                }
+            }
+            return best;
+        }
+
+        auto largest_void() const -> std::size_t
+        {
+            auto best = std::size_t{0};
+            auto best_energy = infinity;
+            for (std::size_t p = 0; p < n * n; ++p)
+            {
+                if (!pattern[p] && energy[p] < best_energy)
+                {
+                    best = p;
+                    best_energy = energy[p];
+                }
+            }
+            return best;
+        }
+    };
+}
+
+auto blue_noise_sampler::blue_noise_mask() -> const std::vector<float> &
+{
+    static const auto mask = []()
+    {
+        auto vc = void_and_cluster{};
+        auto rng = pcg32::seeded(0x626c7565u);
+
+        // initial binary pattern: a tenth of the cells, relaxed by moving the tightest cluster into the largest void
+        const auto initial_count = n * n / 10;
+        for (std::size_t placed = 0; placed < initial_count;)
+        {
+            const auto p = rng.next_u32() % (n * n);
+            if (!vc.pattern[p])
+            {
+                vc.set(p, true);
+                ++placed;
+            }
+        }
+        while (true)
+        {
+            const auto cluster = vc.tightest_cluster();
+            vc.set(cluster, false);
+            const auto gap = vc.largest_void();
+            vc.set(gap, true);
+            if (gap == cluster)
+                break;
+        }
+
+        auto ranks = std::vector<std::size_t>(n * n);
+        const auto initial = vc;
+
+        // phase 1: rank the initial pattern by removing its tightest clusters
+        for (auto rank = initial_count; rank > 0; --rank)
+        {
+            const auto cluster = vc.tightest_cluster();
+            vc.set(cluster, false);
+            ranks[cluster] = rank - 1;
+        }
+
+        // phases 2 and 3: fill the largest voids until every cell is ranked. Past the half way point
+        // the largest void of the ones is the tightest cluster of the zeros, so one rule covers both.
+        vc = initial;
+        for (auto rank = initial_count; rank < n * n; ++rank)
+        {
+            const auto gap = vc.largest_void();
+            vc.set(gap, true);
+            ranks[gap] = rank;
+        }
+
+        auto values = std::vector<float>(n * n);
+        for (std::size_t p = 0; p < n * n; ++p)
+        {
+            values[p] = (ranks[p] + 0.5f) / (n * n);
+        }
+        return values;
+    }();
+    return mask;
+}
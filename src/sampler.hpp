@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "common.hpp"
+
+// A sampler hands out the sample values for one pixel sample, one dimension at a time. Every call to
+// get_1d/get_2d advances to the next dimension, so the camera, the pdfs and the lights each get their
+// own well distributed stream instead of sharing plain randf() values.
+struct sampler
+{
+    virtual ~sampler() = default;
+    virtual auto start_pixel_sample(std::size_t x, std::size_t y, std::size_t sample_index) -> void = 0;
+    virtual auto get_1d() -> float = 0;
+    virtual auto get_2d() -> vec2 = 0;
+};
+
+enum class sampler_type
+{
+    independent,
+    sobol,
+    blue_noise,
+};
+
+struct independent_sampler : sampler
+{
+    auto start_pixel_sample(std::size_t x, std::size_t y, std::size_t sample_index) -> void override {}
+    auto get_1d() -> float override { return randf(); }
+    auto get_2d() -> vec2 override { return {randf(), randf()}; }
+};
+
+// Owen-scrambled Sobol points with per-dimension index shuffling, after Burley's "Practical Hash-based
+// Owen Scrambling" (JCGT 2020). Every dimension pair is an independently scrambled and shuffled copy of
+// the first two Sobol dimensions, so any number of dimensions and any sample count can be drawn.
+struct sobol_sampler : sampler
+{
+    std::uint64_t seed{};
+
+    sobol_sampler(std::uint64_t seed) : seed{seed} {}
+
+    auto start_pixel_sample(std::size_t x, std::size_t y, std::size_t sample_index) -> void override
+    {
+        pixel_seed = hash_u64(seed ^ hash_u64((static_cast<std::uint64_t>(y) << 32) | x));
+        index = static_cast<std::uint32_t>(sample_index);
+        dimension = 0;
+    }
+
+    auto get_1d() -> float override
+    {
+        const auto hash = next_dimension_hash();
+        const auto shuffled = nested_uniform_scramble(index, static_cast<std::uint32_t>(hash));
+        return to_float(nested_uniform_scramble(reverse_bits(shuffled), static_cast<std::uint32_t>(hash >> 32)));
+    }
+
+    auto get_2d() -> vec2 override
+    {
+        const auto hash = next_dimension_hash();
+        const auto shuffled = nested_uniform_scramble(index, static_cast<std::uint32_t>(hash));
+        const auto x = nested_uniform_scramble(reverse_bits(shuffled), static_cast<std::uint32_t>(hash >> 32));
+        const auto y = nested_uniform_scramble(sobol_second_dimension(shuffled), static_cast<std::uint32_t>(hash_u64(hash)));
+        return {to_float(x), to_float(y)};
+    }
+
+private:
+    std::uint64_t pixel_seed{};
+    std::uint32_t index{};
+    std::uint32_t dimension{};
+
+    auto next_dimension_hash() -> std::uint64_t { return hash_u64(pixel_seed + dimension++); }
+
+    static constexpr auto reverse_bits(std::uint32_t x) -> std::uint32_t
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    static constexpr auto sobol_second_dimension(std::uint32_t index) -> std::uint32_t
+    {
+        auto result = std::uint32_t{0};
+        for (auto v = std::uint32_t{1u} << 31; index != 0; index >>= 1, v ^= v >> 1)
+        {
+            if (index & 1u)
+                result ^= v;
+        }
+        return result;
+    }
+
+    static constexpr auto laine_karras_permutation(std::uint32_t x, std::uint32_t seed) -> std::uint32_t
+    {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    static constexpr auto nested_uniform_scramble(std::uint32_t x, std::uint32_t seed) -> std::uint32_t
+    {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+
+    static constexpr auto to_float(std::uint32_t x) -> float
+    {
+        return std::fminf(static_cast<float>(x >> 8) * 0x1p-24f, 0x1.fffffep-1f);
+    }
+};
+
+// Per-pixel values come from a tileable void-and-cluster blue noise mask, offset per dimension and
+// advanced per sample along a golden-ratio (R1) or R2 sequence. Error is pushed to high spatial
+// frequencies, which looks like finer grain at low sample counts.
+struct blue_noise_sampler : sampler
+{
+    static constexpr std::size_t mask_size = 64;
+
+    std::uint64_t seed{};
+
+    blue_noise_sampler(std::uint64_t seed) : seed{seed}, mask{blue_noise_mask()} {}
+
+    auto start_pixel_sample(std::size_t x, std::size_t y, std::size_t sample_index) -> void override
+    {
+        pixel_x = x;
+        pixel_y = y;
+        index = sample_index;
+        dimension = 0;
+    }
+
+    auto get_1d() -> float override
+    {
+        constexpr auto golden = 0.618033988749895;
+        return wrap(mask_value() + index * golden);
+    }
+
+    auto get_2d() -> vec2 override
+    {
+        constexpr auto r2_x = 0.7548776662466927;
+        constexpr auto r2_y = 0.5698402909980532;
+        const auto x = mask_value();
+        const auto y = mask_value();
+        return {wrap(x + index * r2_x), wrap(y + index * r2_y)};
+    }
+
+    // Ranks of a mask_size x mask_size void-and-cluster pattern, normalized to [0, 1). Built once.
+    static auto blue_noise_mask() -> const std::vector<float> &;
+
+private:
+    const std::vector<float> &mask;
+    std::size_t pixel_x{};
+    std::size_t pixel_y{};
+    std::size_t index{};
+    std::uint64_t dimension{};
+
+    auto mask_value() -> double
+    {
+        const auto offset = hash_u64(seed + dimension++);
+        const auto x = (pixel_x + (offset & 0xffffu)) % mask_size;
+        const auto y = (pixel_y + ((offset >> 16) & 0xffffu)) % mask_size;
+        return mask[y * mask_size + x];
+    }
+
+    static auto wrap(double x) -> float
+    {
+        return std::fminf(static_cast<float>(x - std::floor(x)), 0x1.fffffep-1f);
+    }
+};
+
+inline auto make_sampler(sampler_type type, std::uint64_t seed) -> std::unique_ptr<sampler>
+{
+    switch (type)
+    {
+    case sampler_type::sobol:
+        return std::make_unique<sobol_sampler>(seed);
+    case sampler_type::blue_noise:
+        return std::make_unique<blue_noise_sampler>(seed);
+    default:
+        return std::make_unique<independent_sampler>();
+    }
+}
@@ -1,13 +1,12 @@
 #pragma once
 
-#include <memory>
-
 #include "common.hpp"
+#include "pdf.hpp"
 
 struct scatter_result
 {
     color attenuation;
-    std::shared_ptr<pdf> pdf_ptr;
+    pdf sampling_pdf;
     bool skip_pdf;
     ray skip_pdf_ray;
 };
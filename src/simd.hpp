@@ -0,0 +1,55 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RTW_X86_64 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Kernels compiled for instruction sets beyond the build's baseline are tagged with these so a single
+// binary can carry all of them and pick one at runtime. MSVC accepts the intrinsics without a tag.
+#if defined(RTW_X86_64) && (defined(__GNUC__) || defined(__clang__))
+#define RTW_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define RTW_TARGET_AVX2
+#endif
+
+enum class simd_level
+{
+    scalar,
+    sse, // SSE2, available on every x86-64 cpu
+    avx2,
+};
+
+inline auto detect_simd_level() -> simd_level
+{
+#if defined(RTW_X86_64)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        const auto os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+        __cpuidex(info, 7, 0);
+        if (os_saves_ymm && (info[1] & (1 << 5)))
+            return simd_level::avx2;
+    }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return simd_level::avx2;
+#endif
+    return simd_level::sse;
+#else
+    return simd_level::scalar;
+#endif
+}
+
+inline auto cpu_simd_level() -> simd_level
+{
+    static const auto level = detect_simd_level();
+    return level;
+}
@@ -0,0 +1,244 @@
+#include "sphere_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace
+{
+    auto kernel_scalar(const sphere_pool &pool, std::uint32_t first, std::uint32_t count, const ray &r, interval &ray_t, std::uint32_t &nearest) -> bool
+    {
+        const auto a = r.direction.magnitude_squared();
+        bool hit_anything = false;
+        for (auto i = first; i < first + count; ++i)
+        {
+            const auto center = vec3{pool.cx[i] + r.time * pool.mx[i], pool.cy[i] + r.time * pool.my[i], pool.cz[i] + r.time * pool.mz[i]};
+            const auto oc = center - r.origin;
+            const auto h = r.direction.dot(oc);
+            const auto c = oc.magnitude_squared() - pool.radius[i] * pool.radius[i];
+            const auto discriminant = h * h - a * c;
+            if (discriminant < 0.f)
+                continue;
+
+            const auto sqrtd = std::sqrtf(discriminant);
+            auto root = (h - sqrtd) / a;
+            if (!ray_t.surrounds(root))
+            {
+                root = (h + sqrtd) / a;
+                if (!ray_t.surrounds(root))
+                    continue;
+            }
+            ray_t.max = root;
+            nearest = i;
+            hit_anything = true;
+        }
+        return hit_anything;
+    }
+
+    // Keeps the nearest of the lanes in `mask`, whose hit distances are in t.
+    auto take_nearest(unsigned mask, const float *t, std::uint32_t first, interval &ray_t, std::uint32_t &nearest) -> bool
+    {
+        bool hit_anything = false;
+        for (; mask != 0; mask &= mask - 1)
+        {
+            const auto lane = static_cast<std::uint32_t>(std::countr_zero(mask));
+            if (t[lane] < ray_t.max)
+            {
+                ray_t.max = t[lane];
+                nearest = first + lane;
+                hit_anything = true;
+            }
+        }
+        return hit_anything;
+    }
+
+#if defined(RTW_X86_64)
+    // tests the four spheres starting at `first`, of which the lanes in `lanes` are real
+    auto sphere_group_sse(const sphere_pool &pool, std::uint32_t first, unsigned lanes, const ray &r, interval &ray_t, std::uint32_t &nearest) -> bool
+    {
+        const auto time = _mm_set1_ps(r.time);
+        const auto ocx = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(&pool.cx[first]), _mm_mul_ps(time, _mm_loadu_ps(&pool.mx[first]))), _mm_set1_ps(r.origin.x));
+        const auto ocy = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(&pool.cy[first]), _mm_mul_ps(time, _mm_loadu_ps(&pool.my[first]))), _mm_set1_ps(r.origin.y));
+        const auto ocz = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(&pool.cz[first]), _mm_mul_ps(time, _mm_loadu_ps(&pool.mz[first]))), _mm_set1_ps(r.origin.z));
+        const auto radius = _mm_loadu_ps(&pool.radius[first]);
+
+        const auto a = _mm_set1_ps(r.direction.magnitude_squared());
+        const auto h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r.direction.x), ocx), _mm_mul_ps(_mm_set1_ps(r.direction.y), ocy)), _mm_mul_ps(_mm_set1_ps(r.direction.z), ocz));
+        const auto oc_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz));
+        const auto c = _mm_sub_ps(oc_squared, _mm_mul_ps(radius, radius));
+        const auto discriminant = _mm_sub_ps(_mm_mul_ps(h, h), _mm_mul_ps(a, c));
+        const auto real = _mm_cmpge_ps(discriminant, _mm_setzero_ps());
+
+        const auto sqrtd = _mm_sqrt_ps(_mm_max_ps(discriminant, _mm_setzero_ps()));
+        const auto near_root = _mm_div_ps(_mm_sub_ps(h, sqrtd), a);
+        const auto far_root = _mm_div_ps(_mm_add_ps(h, sqrtd), a);
+        const auto t_min = _mm_set1_ps(ray_t.min);
+        const auto t_max = _mm_set1_ps(ray_t.max);
+        const auto near_ok = _mm_and_ps(real, _mm_and_ps(_mm_cmpgt_ps(near_root, t_min), _mm_cmplt_ps(near_root, t_max)));
+        const auto far_ok = _mm_and_ps(real, _mm_and_ps(_mm_cmpgt_ps(far_root, t_min), _mm_cmplt_ps(far_root, t_max)));
+
+        const auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_or_ps(near_ok, far_ok))) & lanes;
+        if (mask == 0)
+            return false;
+        alignas(16) float t[4];
+        _mm_store_ps(t, _mm_or_ps(_mm_and_ps(near_ok, near_root), _mm_andnot_ps(near_ok, far_root)));
+        return take_nearest(mask, t, first, ray_t, nearest);
+    }
+
+    auto kernel_sse(const sphere_pool &pool, std::uint32_t first, std::uint32_t count, const ray &r, interval &ray_t, std::uint32_t &nearest) -> bool
+    {
+        bool hit_anything = false;
+        for (auto group = first; group < first + count; group += 4)
+        {
+            const auto lanes = (1u << std::min(4u, first + count - group)) - 1u;
+            hit_anything |= sphere_group_sse(pool, group, lanes, r, ray_t, nearest);
+        }
+        return hit_anything;
+    }
+
+    RTW_TARGET_AVX2 auto sphere_group_avx2(const sphere_pool &pool, std::uint32_t first, unsigned lanes, const ray &r, interval &ray_t, std::uint32_t &nearest) -> bool
+    {
+        const auto time = _mm256_set1_ps(r.time);
+        const auto ocx = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(&pool.cx[first]), _mm256_mul_ps(time, _mm256_loadu_ps(&pool.mx[first]))), _mm256_set1_ps(r.origin.x));
+        const auto ocy = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(&pool.cy[first]), _mm256_mul_ps(time, _mm256_loadu_ps(&pool.my[first]))), _mm256_set1_ps(r.origin.y));
+        const auto ocz = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(&pool.cz[first]), _mm256_mul_ps(time, _mm256_loadu_ps(&pool.mz[first]))), _mm256_set1_ps(r.origin.z));
+        const auto radius = _mm256_loadu_ps(&pool.radius[first]);
+
+        const auto a = _mm256_set1_ps(r.direction.magnitude_squared());
+        const auto h = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r.direction.x), ocx), _mm256_mul_ps(_mm256_set1_ps(r.direction.y), ocy)), _mm256_mul_ps(_mm256_set1_ps(r.direction.z), ocz));
+        const auto oc_squared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz));
+        const auto c = _mm256_sub_ps(oc_squared, _mm256_mul_ps(radius, radius));
+        const auto discriminant = _mm256_sub_ps(_mm256_mul_ps(h, h), _mm256_mul_ps(a, c));
+        const auto real = _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ);
+
+        const auto sqrtd = _mm256_sqrt_ps(_mm256_max_ps(discriminant, _mm256_setzero_ps()));
+        const auto near_root = _mm256_div_ps(_mm256_sub_ps(h, sqrtd), a);
+        const auto far_root = _mm256_div_ps(_mm256_add_ps(h, sqrtd), a);
+        const auto t_min = _mm256_set1_ps(ray_t.min);
+        const auto t_max = _mm256_set1_ps(ray_t.max);
+        const auto near_ok = _mm256_and_ps(real, _mm256_and_ps(_mm256_cmp_ps(near_root, t_min, _CMP_GT_OQ), _mm256_cmp_ps(near_root, t_max, _CMP_LT_OQ)));
+        const auto far_ok = _mm256_and_ps(real, _mm256_and_ps(_mm256_cmp_ps(far_root, t_min, _CMP_GT_OQ), _mm256_cmp_ps(far_root, t_max, _CMP_LT_OQ)));
+
+        const auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_or_ps(near_ok, far_ok))) & lanes;
+        if (mask == 0)
+            return false;
+        alignas(32) float t[8];
+        _mm256_store_ps(t, _mm256_blendv_ps(far_root, near_root, near_ok));
+        return take_nearest(mask, t, first, ray_t, nearest);
+    }
+
+    RTW_TARGET_AVX2 auto kernel_avx2(const sphere_pool &pool, std::uint32_t first, std::uint32_t count, const ray &r, interval &ray_t, std::uint32_t &nearest) -> bool
+    {
+        bool hit_anything = false;
+        for (auto group = first; group < first + count; group += 8)
+        {
+            const auto lanes = (1u << std::min(8u, first + count - group)) - 1u;
+            hit_anything |= sphere_group_avx2(pool, group, lanes, r, ray_t, nearest);
+        }
+        return hit_anything;
+    }
+#endif
+}
+
+auto sphere_pool_lanes(simd_level level) -> std::size_t
+{
+    if (level == simd_level::avx2)
+        return 8;
+    if (level == simd_level::sse)
+        return 4;
+    return 1;
+}
+
+auto select_sphere_pool_kernel(simd_level level) -> sphere_pool_kernel
+{
+#if defined(RTW_X86_64)
+    if (level == simd_level::avx2)
+        return kernel_avx2;
+    if (level == simd_level::sse)
+        return kernel_sse;
+#endif
+    return kernel_scalar;
+}
+
+auto sphere_pool::from_spheres(const std::vector<sphere> &spheres, const bvh_build_options &options, simd_level level) -> sphere_pool
+{
+    auto prims = std::vector<bvh_build_primitive>(spheres.size());
+    for (std::size_t i = 0; i < spheres.size(); ++i)
+    {
+        const auto bounds = spheres[i].bbox();
+        prims[i] = {bounds, bounds.centroid(), static_cast<std::uint32_t>(i)};
+    }
+
+    // a leaf costs one kernel call whether it holds one sphere or a full vector
+    const auto lanes = sphere_pool_lanes(level);
+    auto leaf_options = options;
+    leaf_options.max_leaf_size = std::max(options.max_leaf_size, lanes);
+    leaf_options.leaf_lanes = lanes;
+
+    auto pool = sphere_pool{};
+    pool.tree = bvh_tree::build(std::move(prims), leaf_options);
+    pool.kernel = select_sphere_pool_kernel(level);
+    pool.count = spheres.size();
+
+    const auto size = spheres.size() + padding;
+    for (auto *column : {&pool.cx, &pool.cy, &pool.cz, &pool.mx, &pool.my, &pool.mz, &pool.radius})
+        column->resize(size, 0.f);
+    pool.mat.resize(size, no_material);
+    pool.id.resize(size, no_primitive);
+    for (std::size_t i = 0; i < spheres.size(); ++i)
+    {
+        const auto &s = spheres[pool.tree.order[i]];
+        pool.cx[i] = s.center.origin.x;
+        pool.cy[i] = s.center.origin.y;
+        pool.cz[i] = s.center.origin.z;
+        pool.mx[i] = s.center.direction.x;
+        pool.my[i] = s.center.direction.y;
+        pool.mz[i] = s.center.direction.z;
+        pool.radius[i] = s.radius;
+        pool.mat[i] = s.mat;
+        pool.id[i] = s.id;
+    }
+    // the order is only needed for the copy above
+    pool.tree.order = {};
+    return pool;
+}
+
+auto sphere_pool::intersect(const ray &r, const interval &t, intersection &isect) const -> bool
+{
+    auto nearest = std::uint32_t{0};
+    auto nearest_t = 0.f;
+    const auto found = tree.traverse(r, t, [&](std::uint32_t first, std::uint32_t leaf_count, interval &ray_t)
+                                     {
+        if (!kernel(*this, first, leaf_count, r, ray_t, nearest))
+            return false;
+        nearest_t = ray_t.max;
+        return true; });
+    if (!found)
+        return false;
+
+    isect.set(this, nearest_t, 0.f, 0.f, nearest);
+    return true;
+}
+
+auto sphere_pool::compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void
+{
+    const auto i = isect.index;
+    const auto motion = vec3{mx[i], my[i], mz[i]};
+    const auto center = vec3{cx[i], cy[i], cz[i]} + r.time * motion;
+    res.p = r.at(isect.t);
+    const auto outward_normal = (res.p - center) / radius[i];
+    res.set_face_normal(r, outward_normal);
+    sphere::get_sphere_uv(outward_normal, res.u, res.v);
+    res.velocity = motion;
+    res.mat = mat[i];
+    res.prim = id[i];
+}
+
+auto sphere_pool::occluded(const ray &r, const interval &t) const -> bool
+{
+    return tree.traverse<true>(r, t, [&](std::uint32_t first, std::uint32_t leaf_count, const interval &ray_t)
+                               {
+        auto leaf_t = ray_t;
+        auto nearest = std::uint32_t{0};
+        return kernel(*this, first, leaf_count, r, leaf_t, nearest); });
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common.hpp"
+#include "raytraceable.hpp"
+#include "bvh.hpp"
+#include "simd.hpp"
+
+struct sphere_pool;
+
+// Intersects the spheres [first, first + count) of a pool. Returns whether one is hit within ray_t,
+// shrinking ray_t.max to the nearest hit and setting nearest to its index.
+using sphere_pool_kernel = auto (*)(const sphere_pool &pool, std::uint32_t first, std::uint32_t count, const ray &r, interval &ray_t, std::uint32_t &nearest) -> bool;
+
+// Number of spheres the kernel for `level` tests at once.
+auto sphere_pool_lanes(simd_level level) -> std::size_t;
+auto select_sphere_pool_kernel(simd_level level) -> sphere_pool_kernel;
+
+// Many spheres as one object. Centers, motion, radii, materials and ids are stored structure-of-arrays
+// and the bvh leaves hold up to one vector of spheres, which the kernel tests with one pass of SIMD
+// instructions. Leaf tests only find the nearest sphere and its t, which intersect records with its
+// index; compute_interaction works out the normal, uv and the rest for that sphere alone.
+struct sphere_pool : raytraceable
+{
+    // every array has this many zeroed entries past the last sphere, so kernels can load whole vectors
+    static constexpr std::size_t padding = 8;
+
+    std::vector<float> cx{}, cy{}, cz{}; // center at time 0
+    std::vector<float> mx{}, my{}, mz{}; // movement of the center from time 0 to time 1
+    std::vector<float> radius{};
+    std::vector<material_id> mat{};
+    std::vector<primitive_id> id{};
+    std::size_t count = 0;
+    bvh_tree tree{};
+    sphere_pool_kernel kernel = nullptr;
+
+    // Copies the spheres, keeping their materials and primitive ids, and builds the bvh with leaves of
+    // up to one kernel's width.
+    static auto from_spheres(const std::vector<sphere> &spheres, const bvh_build_options &options = {}, simd_level level = cpu_simd_level()) -> sphere_pool;
+
+    auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool override;
+    auto compute_interaction(const ray &r, const intersection &isect, std::size_t level, hit_result &res) const -> void override;
+    auto occluded(const ray &r, const interval &t) const -> bool override;
+    auto bbox() const -> aabb override { return tree.bbox(); }
+};
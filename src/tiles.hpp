@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// A rectangle of pixels [x0, x1) x [y0, y1).
+struct tile
+{
+    std::size_t x0{}, y0{};
+    std::size_t x1{}, y1{};
+
+    auto pixel_count() const -> std::size_t { return (x1 - x0) * (y1 - y0); }
+};
+
+// Maps distance d along a Hilbert curve over an n x n grid (n a power of two) to cell (x, y).
+inline auto hilbert_cell(std::size_t n, std::size_t d, std::size_t &x, std::size_t &y) -> void
+{
+    x = 0;
+    y = 0;
+    for (std::size_t s = 1; s < n; s *= 2)
+    {
+        const auto rx = 1 & (d / 2);
+        const auto ry = 1 & (d ^ rx);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+        x += s * rx;
+        y += s * ry;
+        d /= 4;
+    }
+}
+
+// Hands out the tiles of an image in Hilbert curve order, so consecutive tiles (and the threads
+// working on them) stay close together in the scene. Threads take the next tile from a shared
+// atomic counter, so a thread that lands on cheap tiles simply takes more of them.
+struct tile_queue
+{
+    std::vector<tile> tiles{};
+    std::atomic<std::size_t> next{0};
+
+    static auto hilbert(std::size_t width, std::size_t height, std::size_t tile_size) -> std::vector<tile>
+    {
+        tile_size = std::max<std::size_t>(tile_size, 1);
+        const auto tiles_x = (width + tile_size - 1) / tile_size;
+        const auto tiles_y = (height + tile_size - 1) / tile_size;
+
+        auto n = std::size_t{1};
+        while (n < std::max(tiles_x, tiles_y))
+            n *= 2;
+
+        auto tiles = std::vector<tile>{};
+        tiles.reserve(tiles_x * tiles_y);
+        for (std::size_t d = 0; d < n * n; ++d)
+        {
+            std::size_t tx, ty;
+            hilbert_cell(n, d, tx, ty);
+            if (tx >= tiles_x || ty >= tiles_y)
+                continue;
+            tiles.push_back(tile{tx * tile_size, ty * tile_size,
+                                 std::min(width, (tx + 1) * tile_size), std::min(height, (ty + 1) * tile_size)});
+        }
+        return tiles;
+    }
+
+    tile_queue(std::vector<tile> tiles) : tiles{std::move(tiles)} {}
+
+    auto pop(tile &t) -> bool
+    {
+        const auto i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= tiles.size())
+            return false;
+        t = tiles[i];
+        return true;
+    }
+};
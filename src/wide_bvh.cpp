@@ -0,0 +1,238 @@
+#include "wide_bvh.hpp"
+
+namespace
+{
+    template <std::size_t width>
+    auto slab_test_scalar(const wide_bvh_node<width> &node, const vec3 &origin, const vec3 &inv_dir, interval ray_t, float *t_near) -> unsigned
+    {
+        auto mask = 0u;
+        for (std::size_t c = 0; c < node.child_count; ++c)
+        {
+            auto t_min = ray_t.min;
+            auto t_max = ray_t.max;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const auto t0 = (node.lo[axis][c] - origin.data[axis]) * inv_dir.data[axis];
+                const auto t1 = (node.hi[axis][c] - origin.data[axis]) * inv_dir.data[axis];
+                t_min = std::max(t_min, std::min(t0, t1));
+                t_max = std::min(t_max, std::max(t0, t1));
+            }
+            t_near[c] = t_min;
+            if (t_min < t_max)
+                mask |= 1u << c;
+        }
+        return mask;
+    }
+
+#if defined(RTW_X86_64)
+    // tests the four child boxes starting at slot `first`
+    template <std::size_t width>
+    auto slab_test_sse_4(const wide_bvh_node<width> &node, std::size_t first, const vec3 &origin, const vec3 &inv_dir, interval ray_t, float *t_near) -> unsigned
+    {
+        auto t_min = _mm_set1_ps(ray_t.min);
+        auto t_max = _mm_set1_ps(ray_t.max);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const auto o = _mm_set1_ps(origin.data[axis]);
+            const auto inv = _mm_set1_ps(inv_dir.data[axis]);
+            const auto t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.lo[axis] + first), o), inv);
+            const auto t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.hi[axis] + first), o), inv);
+            t_min = _mm_max_ps(t_min, _mm_min_ps(t0, t1));
+            t_max = _mm_min_ps(t_max, _mm_max_ps(t0, t1));
+        }
+        _mm_storeu_ps(t_near + first, t_min);
+        return static_cast<unsigned>(_mm_movemask_ps(_mm_cmplt_ps(t_min, t_max))) << first;
+    }
+
+    template <std::size_t width>
+    auto slab_test_sse(const wide_bvh_node<width> &node, const vec3 &origin, const vec3 &inv_dir, interval ray_t, float *t_near) -> unsigned
+    {
+        auto mask = 0u;
+        for (std::size_t first = 0; first < node.child_count; first += 4)
+            mask |= slab_test_sse_4(node, first, origin, inv_dir, ray_t, t_near);
+        return mask & ((1u << node.child_count) - 1u);
+    }
+
+    RTW_TARGET_AVX2 auto slab_test_avx2(const wide_bvh_node<8> &node, const vec3 &origin, const vec3 &inv_dir, interval ray_t, float *t_near) -> unsigned
+    {
+        auto t_min = _mm256_set1_ps(ray_t.min);
+        auto t_max = _mm256_set1_ps(ray_t.max);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const auto o = _mm256_set1_ps(origin.data[axis]);
+            const auto inv = _mm256_set1_ps(inv_dir.data[axis]);
+            const auto t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.lo[axis]), o), inv);
+            const auto t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.hi[axis]), o), inv);
+            t_min = _mm256_max_ps(t_min, _mm256_min_ps(t0, t1));
+            t_max = _mm256_min_ps(t_max, _mm256_max_ps(t0, t1));
+        }
+        _mm256_storeu_ps(t_near, t_min);
+        const auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(t_min, t_max, _CMP_LT_OQ)));
+        return mask & ((1u << node.child_count) - 1u);
+    }
+#endif
+
+    template <std::size_t width>
+    auto collapse(std::vector<wide_bvh_node<width>> &nodes, const std::vector<bvh_node> &binary, std::uint32_t binary_index) -> std::uint32_t
+    {
+        // open the interior candidate with the largest surface area until the node is full
+        std::uint32_t candidates[width];
+        std::size_t candidate_count = 0;
+        if (binary[binary_index].is_leaf())
+        {
+            candidates[candidate_count++] = binary_index;
+        }
+        else
+        {
+            candidates[candidate_count++] = binary_index + 1;
+            candidates[candidate_count++] = binary[binary_index].offset;
+        }
+
+        while (candidate_count < width)
+        {
+            auto best = candidate_count;
+            auto best_area = -infinity;
+            for (std::size_t c = 0; c < candidate_count; ++c)
+            {
+                const auto &candidate = binary[candidates[c]];
+                if (!candidate.is_leaf() && candidate.bounds().surface_area() > best_area)
+                {
+                    best = c;
+                    best_area = candidate.bounds().surface_area();
+                }
+            }
+            if (best == candidate_count)
+                break;
+
+            const auto opened = candidates[best];
+            candidates[best] = opened + 1;
+            candidates[candidate_count++] = binary[opened].offset;
+        }
+
+        const auto node_index = static_cast<std::uint32_t>(nodes.size());
+        nodes.emplace_back();
+
+        auto node = wide_bvh_node<width>{};
+        node.child_count = static_cast<std::uint8_t>(candidate_count);
+        for (std::size_t c = 0; c < width; ++c)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                node.lo[axis][c] = infinity;
+                node.hi[axis][c] = -infinity;
+            }
+            node.child[c] = 0;
+            node.count[c] = 0;
+        }
+
+        for (std::size_t c = 0; c < candidate_count; ++c)
+        {
+            const auto &candidate = binary[candidates[c]];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                node.lo[axis][c] = candidate.bounds_min[axis];
+                node.hi[axis][c] = candidate.bounds_max[axis];
+            }
+            if (candidate.is_leaf())
+            {
+                node.child[c] = candidate.offset;
+                node.count[c] = candidate.count;
+            }
+            else
+            {
+                node.child[c] = collapse(nodes, binary, candidates[c]);
+            }
+        }
+
+        nodes[node_index] = node;
+        return node_index;
+    }
+}
+
+template <>
+auto select_wide_bvh_slab_test<4>(simd_level level) -> wide_bvh_slab_test<4>
+{
+#if defined(RTW_X86_64)
+    if (level != simd_level::scalar)
+        return slab_test_sse<4>;
+#endif
+    return slab_test_scalar<4>;
+}
+
+template <>
+auto select_wide_bvh_slab_test<8>(simd_level level) -> wide_bvh_slab_test<8>
+{
+#if defined(RTW_X86_64)
+    if (level == simd_level::avx2)
+        return slab_test_avx2;
+    if (level == simd_level::sse)
+        return slab_test_sse<8>;
+#endif
+    return slab_test_scalar<8>;
+}
+
+namespace
+{
+    // Refits the subtree below node_index and returns its bounds, adding the cost of its nodes and leaves.
+    template <std::size_t width>
+    auto refit_node(std::vector<wide_bvh_node<width>> &nodes, const std::vector<std::shared_ptr<raytraceable>> &objs, std::uint32_t node_index, float &cost) -> aabb
+    {
+        auto node_box = aabb::empty;
+        const auto child_count = nodes[node_index].child_count;
+        for (std::size_t c = 0; c < child_count; ++c)
+        {
+            auto box = aabb::empty;
+            const auto first = nodes[node_index].child[c];
+            const auto count = nodes[node_index].count[c];
+            if (count > 0)
+            {
+                for (auto i = first; i < first + count; ++i)
+                    box = aabb::from_aabbs(box, objs[i]->bbox());
+                cost += count * box.surface_area();
+            }
+            else
+            {
+                box = refit_node(nodes, objs, first, cost);
+            }
+
+            auto &node = nodes[node_index];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                node.lo[axis][c] = box.axis_interval(axis).min;
+                node.hi[axis][c] = box.axis_interval(axis).max;
+            }
+            node_box = aabb::from_aabbs(node_box, box);
+        }
+        cost += node_box.surface_area();
+        return node_box;
+    }
+}
+
+template <std::size_t width>
+auto wide_bvh<width>::refit() -> float
+{
+    if (nodes.empty())
+        return 0.f;
+    auto cost = 0.f;
+    m_bbox = refit_node(nodes, objs, 0, cost);
+    return cost / std::max(m_bbox.surface_area(), 1e-12f);
+}
+
+template <std::size_t width>
+auto wide_bvh<width>::from_bvh(bvh &&binary, simd_level level) -> wide_bvh
+{
+    auto w = wide_bvh{};
+    w.m_bbox = binary.bbox();
+    w.slab_test = select_wide_bvh_slab_test<width>(level);
+    if (!binary.tree.nodes.empty())
+    {
+        w.nodes.reserve(binary.tree.nodes.size() / 2 + 1);
+        collapse(w.nodes, binary.tree.nodes, 0);
+        w.nodes.shrink_to_fit();
+    }
+    w.objs = std::move(binary.objs);
+    return w;
+}
+
+template struct wide_bvh<4>;
+template struct wide_bvh<8>;
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "simd.hpp"
+
+// A node of a bvh collapsed to `width` children. Child boxes are stored structure-of-arrays so all of
+// them can be slab tested with one pass of vector instructions. Unused slots sit past child_count.
+template <std::size_t width>
+struct alignas(32) wide_bvh_node
+{
+    float lo[3][width]; // per axis minimum of every child box
+    float hi[3][width]; // per axis maximum of every child box
+    std::uint32_t child[width]; // interior child: node index, leaf child: first primitive
+    std::uint16_t count[width]; // leaf child: number of primitives, interior child: 0
+    std::uint8_t child_count;
+};
+
+// Slab tests every child of a node at once, writing the entry distance of each child and returning a
+// bit mask of the children the ray overlaps within ray_t.
+template <std::size_t width>
+using wide_bvh_slab_test = auto (*)(const wide_bvh_node<width> &node, const vec3 &origin, const vec3 &inv_dir, interval ray_t, float *t_near) -> unsigned;
+
+template <std::size_t width>
+auto select_wide_bvh_slab_test(simd_level level) -> wide_bvh_slab_test<width>;
+
+template <std::size_t width>
+struct wide_bvh : bvh
+{
+    std::vector<wide_bvh_node<width>> nodes{};
+    aabb m_bbox{};
+    wide_bvh_slab_test<width> slab_test = nullptr;
+
+    // Collapses a binary bvh, taking over its primitives. The binary node array is released.
+    static auto from_bvh(bvh &&binary, simd_level level = cpu_simd_level()) -> wide_bvh;
+
+    auto intersect(const ray &r, const interval &t, intersection &isect) const -> bool override
+    {
+        return traverse(r, t, [&](std::uint32_t first, std::uint32_t count, interval &ray_t)
+                        {
+            bool hit_anything = false;
+            for (auto i = first; i < first + count; ++i)
+            {
+                if (objs[i]->intersect(r, ray_t, isect))
+                {
+                    hit_anything = true;
+                    ray_t.max = isect.t;
+                }
+            }
+            return hit_anything; });
+    }
+
+    auto occluded(const ray &r, const interval &t) const -> bool override
+    {
+        return traverse<true>(r, t, [&](std::uint32_t first, std::uint32_t count, const interval &ray_t)
+                              {
+            for (auto i = first; i < first + count; ++i)
+            {
+                if (objs[i]->occluded(r, ray_t))
+                    return true;
+            }
+            return false; });
+    }
+
+    auto bbox() const -> aabb override { return m_bbox; }
+
+    auto refit() -> float override;
+
+    // Same contract as bvh_tree::traverse.
+    template <bool any_hit = false, typename leaf_hit_fn>
+    auto traverse(const ray &r, const interval &t, leaf_hit_fn &&leaf_hit) const -> bool
+    {
+        if (nodes.empty())
+            return false;
+
+        struct entry
+        {
+            std::uint32_t index;
+            std::uint32_t count;
+            float t_near;
+        };
+
+        const auto inv_dir = vec3{1.f / r.direction.x, 1.f / r.direction.y, 1.f / r.direction.z};
+        auto ray_t = t;
+        bool hit_anything = false;
+
+        // every pop pushes at most width entries, and wide nodes are no deeper than the binary ones
+        entry stack[(width - 1) * bvh_max_depth + 1];
+        std::size_t stack_size = 0;
+        stack[stack_size++] = entry{0, 0, ray_t.min};
+
+        while (stack_size > 0)
+        {
+            const auto current = stack[--stack_size];
+            if (current.t_near >= ray_t.max)
+                continue;
+
+            if (current.count > 0)
+            {
+                hit_anything |= leaf_hit(current.index, current.count, ray_t);
+                if constexpr (any_hit)
+                {
+                    if (hit_anything)
+                        break;
+                }
+                continue;
+            }
+
+            const auto &node = nodes[current.index];
+            float t_near[width];
+            auto mask = slab_test(node, r.origin, inv_dir, ray_t, t_near);
+
+            // push the hit children far to near so the nearest one is popped first
+            entry hits[width];
+            std::size_t hit_count = 0;
+            for (; mask != 0; mask &= mask - 1)
+            {
+                const auto c = static_cast<std::size_t>(std::countr_zero(mask));
+                auto e = entry{node.child[c], node.count[c], t_near[c]};
+                auto k = hit_count++;
+                for (; k > 0 && hits[k - 1].t_near < e.t_near; --k)
+                    hits[k] = hits[k - 1];
+                hits[k] = e;
+            }
+            for (std::size_t k = 0; k < hit_count; ++k)
+                stack[stack_size++] = hits[k];
+        }
+
+        return hit_anything;
+    }
+};